@@ -0,0 +1,239 @@
+//***************************************************************************
+// File alloc.cc
+// Date 18.10.26 - #1
+// Copyright (c) 2017-2026 s710 (s710 (at) posteo (dot) de). All rights reserved.
+// --------------------------------------------------------------------------
+// Ark ClusterChat / heap allocation accounting per subsystem
+//***************************************************************************
+
+#include <stdio.h>
+#include <stdint.h>
+#include <string.h>
+#include <errno.h>
+
+#include "alloc.hpp"
+#include "thread.hpp"
+
+AllocStats::Counters AllocStats::counters[atCount];
+thread_local int AllocStats::tag= atOther;
+
+//***************************************************************************
+// allocator hooks
+//***************************************************************************
+// glibc supports replacing malloc by symbol interposition, the original
+// is still reachable as __libc_*. realloc always moves, the instrumented
+// build is for counting, not for speed.
+//***************************************************************************
+
+#ifdef ALLOCSTATS
+
+extern "C" void* __libc_malloc(size_t size);
+extern "C" void __libc_free(void* p);
+
+struct AllocHeader
+{
+   size_t size;
+   unsigned int offset;     // of the user block from the real one
+   unsigned int tag;
+};
+
+#define ALLOC_HEADER sizeof(AllocHeader)      // 16, keeps malloc alignment
+
+static void* track(char* base, size_t size, size_t offset)
+{
+   if (!base)
+      return 0;
+
+   AllocHeader* h= (AllocHeader*)(base + offset) - 1;
+   AllocStats::Counters* c= &AllocStats::counters[AllocStats::tag];
+
+   h->size= size;
+   h->offset= offset;
+   h->tag= AllocStats::tag;
+
+   c->allocs.fetch_add(1, std::memory_order_relaxed);
+   c->bytes.fetch_add(size, std::memory_order_relaxed);
+   c->live.fetch_add(size, std::memory_order_relaxed);
+
+   return h + 1;
+}
+
+static void* alignedAlloc(size_t align, size_t size)
+{
+   if (align <= ALLOC_HEADER)
+      return track((char*)__libc_malloc(size + ALLOC_HEADER), size, ALLOC_HEADER);
+
+   char* base= (char*)__libc_malloc(size + align + ALLOC_HEADER);
+
+   if (!base)
+      return 0;
+
+   uintptr_t user= ((uintptr_t)base + ALLOC_HEADER + align - 1) & ~(uintptr_t)(align - 1);
+
+   return track(base, size, user - (uintptr_t)base);
+}
+
+extern "C" void* malloc(size_t size)
+{
+   return track((char*)__libc_malloc(size + ALLOC_HEADER), size, ALLOC_HEADER);
+}
+
+extern "C" void free(void* p)
+{
+   if (!p)
+      return;
+
+   AllocHeader* h= (AllocHeader*)p - 1;
+   AllocStats::Counters* c= &AllocStats::counters[h->tag];
+
+   c->frees.fetch_add(1, std::memory_order_relaxed);
+   c->live.fetch_sub(h->size, std::memory_order_relaxed);
+
+   __libc_free((char*)p - h->offset);
+}
+
+extern "C" void* calloc(size_t n, size_t size)
+{
+   if (size && n > (size_t)-1 / size)
+   {
+      errno= ENOMEM;
+      return 0;
+   }
+
+   void* p= malloc(n * size);
+
+   if (p)
+      memset(p, 0, n * size);
+
+   return p;
+}
+
+extern "C" void* realloc(void* p, size_t size)
+{
+   if (!p)
+      return malloc(size);
+
+   if (!size)
+   {
+      free(p);
+      return 0;
+   }
+
+   void* res= malloc(size);
+   size_t old= ((AllocHeader*)p - 1)->size;
+
+   if (!res)
+      return 0;
+
+   memcpy(res, p, old < size ? old : size);
+   free(p);
+
+   return res;
+}
+
+extern "C" void* memalign(size_t align, size_t size)        { return alignedAlloc(align, size); }
+extern "C" void* aligned_alloc(size_t align, size_t size)   { return alignedAlloc(align, size); }
+extern "C" void* valloc(size_t size)                        { return alignedAlloc(4096, size); }
+extern "C" void* pvalloc(size_t size)                       { return alignedAlloc(4096, (size + 4095) & ~(size_t)4095); }
+extern "C" size_t malloc_usable_size(void* p)               { return p ? ((AllocHeader*)p - 1)->size : 0; }
+
+extern "C" int posix_memalign(void** p, size_t align, size_t size)
+{
+   if (!align || (align & (align - 1)) || align % sizeof(void*))
+      return EINVAL;
+
+   if (!(*p= alignedAlloc(align, size)))
+      return ENOMEM;
+
+   return 0;
+}
+
+#endif // ALLOCSTATS
+
+//***************************************************************************
+// available
+//***************************************************************************
+
+int AllocStats::available()
+{
+#ifdef ALLOCSTATS
+   return yes;
+#else
+   return no;
+#endif
+}
+
+//***************************************************************************
+// tag name
+//***************************************************************************
+
+const char* AllocStats::tagName(int tag)
+{
+   static const char* names[atCount]= { "other", "channel", "ingest", "relay", "format", "write" };
+
+   return tag >= 0 && tag < atCount ? names[tag] : "unknown";
+}
+
+//***************************************************************************
+// report
+//***************************************************************************
+
+void AllocStats::report()
+{
+   // rates since the last call, only called by the main thread
+
+   static unsigned long long lastAllocs[atCount];
+   static unsigned long long lastBytes[atCount];
+   static unsigned long long last= 0;
+
+   unsigned long long now= msNow();
+   double seconds= last && now > last ? (now - last) / 1000.0 : 0;
+
+   printf("Alloc: %-8s %12s %14s %12s\n", "", "allocs/s", "bytes/s", "live [kB]");
+
+   for (int t= 0; t < atCount; t++)
+   {
+      unsigned long long allocs= counters[t].allocs.load(std::memory_order_relaxed);
+      unsigned long long bytes= counters[t].bytes.load(std::memory_order_relaxed);
+
+      printf("Alloc: %-8s %12.1f %14.0f %12.1f\n", tagName(t),
+             seconds ? (allocs - lastAllocs[t]) / seconds : 0, seconds ? (bytes - lastBytes[t]) / seconds : 0,
+             counters[t].live.load(std::memory_order_relaxed) / 1024.0);
+
+      lastAllocs[t]= allocs;
+      lastBytes[t]= bytes;
+   }
+
+   last= now;
+}
+
+//***************************************************************************
+// check
+//***************************************************************************
+
+int AllocStats::check(unsigned long long messages)
+{
+   // allocations of the relay path per delivered message (--alloc-limit)
+
+   unsigned long long allocs= 0;
+
+   if (Globals::cfgAllocLimit < 0)
+      return success;
+
+   for (int t= atOther + 1; t < atCount; t++)
+      allocs+= counters[t].allocs.load(std::memory_order_relaxed);
+
+   double perMessage= messages ? (double)allocs / messages : 0;
+
+   printf("Alloc: %llu allocation(s) in the relay path for %llu message(s), %.2f per message\n",
+          allocs, messages, perMessage);
+
+   if (perMessage > Globals::cfgAllocLimit)
+   {
+      fprintf(stderr, "Alloc: Error: %.2f allocations per message exceed the limit of %.2f\n",
+              perMessage, Globals::cfgAllocLimit);
+      return fail;
+   }
+
+   return success;
+}
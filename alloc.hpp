@@ -0,0 +1,86 @@
+//***************************************************************************
+// File alloc.hpp
+// Date 18.10.26 - #1
+// Copyright (c) 2017-2026 s710 (s710 (at) posteo (dot) de). All rights reserved.
+// --------------------------------------------------------------------------
+// Ark ClusterChat / heap allocation accounting per subsystem
+//***************************************************************************
+
+#ifndef __ALLOC_HPP__
+#define __ALLOC_HPP__
+
+#include <atomic>
+
+#include "def.h"
+
+//***************************************************************************
+// subsystems
+//***************************************************************************
+
+enum AllocTag
+{
+   atOther,          // startup, config, resolver, metrics, ...
+   atChannel,        // RCON packet send/receive
+   atIngest,         // GetChat response to lines
+   atRelay,          // fan-out of a line to the destination queues
+   atFormat,         // outbound commands
+   atWrite,          // ServerChat delivery
+
+   atCount
+};
+
+#ifdef ALLOCSTATS
+#  define ALLOC_SCOPE(tag) AllocScope __allocScope(tag)
+#else
+#  define ALLOC_SCOPE(tag)
+#endif
+
+//***************************************************************************
+// class AllocStats
+//***************************************************************************
+// built with ALLOCSTATS=1 malloc, calloc, realloc, free and the aligned
+// variants are replaced, operator new/delete of libstdc++ and strdup()
+// end up there as well. each block carries a small header with its size
+// and the subsystem (innermost ALLOC_SCOPE of the allocating thread), so
+// a block freed elsewhere is still booked against its owner.
+//***************************************************************************
+
+class AllocStats
+{
+   public:
+
+      struct Counters
+      {
+         std::atomic<unsigned long long> allocs;
+         std::atomic<unsigned long long> frees;
+         std::atomic<unsigned long long> bytes;
+         std::atomic<long long> live;           // [bytes]
+      };
+
+      static int available();
+      static const char* tagName(int tag);
+      static void report();
+      static int check(unsigned long long messages);
+
+      static Counters counters[atCount];
+      static thread_local int tag;
+};
+
+//***************************************************************************
+// class AllocScope
+//***************************************************************************
+
+class AllocScope
+{
+   public:
+
+      AllocScope(int aTag)  { previous= AllocStats::tag; AllocStats::tag= aTag; }
+      ~AllocScope()         { AllocStats::tag= previous; }
+
+   private:
+
+      int previous;
+};
+
+//***************************************************************************
+#endif // __ALLOC_HPP__
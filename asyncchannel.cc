@@ -0,0 +1,589 @@
+//***************************************************************************
+// File asyncchannel.cc
+// Date 18.10.26 - #1
+// Copyright (c) 2017-2026 s710 (s710 (at) posteo (dot) de). All rights reserved.
+// --------------------------------------------------------------------------
+// Ark ClusterChat / coroutine based (non-blocking) RCON client
+//***************************************************************************
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <errno.h>
+#include <algorithm>
+
+#include <sys/types.h>
+#include <sys/socket.h>
+#include <netinet/in.h>
+
+#include "asyncchannel.hpp"
+#include "thread.hpp"
+
+//***************************************************************************
+// class EventLoop
+//***************************************************************************
+// ctor/dtor
+//***************************************************************************
+
+EventLoop::EventLoop()
+{
+   tasks= 0;
+   stopped= no;
+}
+
+EventLoop::~EventLoop()
+{
+   // tasks still suspended (loop was stopped) are not destroyed here,
+   // their frames may reference channels which are already gone
+}
+
+//***************************************************************************
+// spawn
+//***************************************************************************
+
+void EventLoop::spawn(AsyncTask task)
+{
+   tasks++;
+   ready.push_back(task.handle);
+}
+
+//***************************************************************************
+// resume
+//***************************************************************************
+
+void EventLoop::resume(std::coroutine_handle<> h)
+{
+   // tasks don't nest, so the resumed handle is always the task itself
+
+   h.resume();
+
+   if (h.done())
+   {
+      h.destroy();
+      tasks--;
+   }
+}
+
+//***************************************************************************
+// watch/unwatch
+//***************************************************************************
+
+void EventLoop::watch(AsyncRConChannel* channel)
+{
+   if (std::find(channels.begin(), channels.end(), channel) == channels.end())
+      channels.push_back(channel);
+}
+
+void EventLoop::unwatch(AsyncRConChannel* channel)
+{
+   std::vector<AsyncRConChannel*>::iterator it= std::find(channels.begin(), channels.end(), channel);
+
+   if (it != channels.end())
+   {
+      *it= channels.back();
+      channels.pop_back();
+   }
+}
+
+//***************************************************************************
+// Sleep
+//***************************************************************************
+
+void EventLoop::SleepAwaiter::await_suspend(std::coroutine_handle<> h)
+{
+   Timer t;
+   t.due= msNow() + ms;
+   t.handle= h;
+
+   loop->timers.push_back(t);
+   std::push_heap(loop->timers.begin(), loop->timers.end(), EventLoop::timerLater);
+}
+
+//***************************************************************************
+// next timeout
+//***************************************************************************
+
+int EventLoop::nextTimeout()
+{
+   unsigned long long now= msNow();
+   unsigned long long due= now + 1000;
+
+   if (!ready.empty())
+      return 0;
+
+   if (!timers.empty() && timers.front().due < due)
+      due= timers.front().due;
+
+   for (size_t i= 0; i < channels.size(); i++)
+      if (channels[i]->busy && channels[i]->deadline < due)
+         due= channels[i]->deadline;
+
+   return due > now ? (int)(due - now) : 0;
+}
+
+//***************************************************************************
+// process timers
+//***************************************************************************
+
+void EventLoop::processTimers()
+{
+   unsigned long long now= msNow();
+
+   while (!timers.empty() && timers.front().due <= now)
+   {
+      std::coroutine_handle<> h= timers.front().handle;
+
+      std::pop_heap(timers.begin(), timers.end(), EventLoop::timerLater);
+      timers.pop_back();
+
+      resume(h);
+   }
+
+   // command timeouts. completing may change 'channels', so restart
+
+   for (size_t i= 0; i < channels.size(); i++)
+   {
+      AsyncRConChannel* channel= channels[i];
+
+      if (channel->busy && channel->deadline <= now)
+      {
+         fprintf(stderr, "Error: RCON command timed out\n");
+         channel->disconnect();
+         channel->complete(fail);
+         i= (size_t)-1;
+      }
+   }
+}
+
+//***************************************************************************
+// run
+//***************************************************************************
+
+int EventLoop::run()
+{
+   std::vector<pollfd> fds;
+   std::vector<AsyncRConChannel*> polled;
+   std::vector<int> generations;
+
+   stopped= no;
+
+   while (!stopped && tasks > 0)
+   {
+      // (1) start freshly spawned tasks
+
+      while (!ready.empty())
+      {
+         std::coroutine_handle<> h= ready.front();
+         ready.pop_front();
+         resume(h);
+      }
+
+      // (2) wait for I/O
+
+      fds.clear();
+      polled.clear();
+      generations.clear();
+
+      for (size_t i= 0; i < channels.size(); i++)
+      {
+         pollfd p;
+         p.fd= channels[i]->rsock;
+         p.events= (short)channels[i]->events();
+         p.revents= 0;
+
+         fds.push_back(p);
+         polled.push_back(channels[i]);
+         generations.push_back(channels[i]->generation);
+      }
+
+      int res= ::poll(fds.empty() ? 0 : &fds[0], fds.size(), nextTimeout());
+
+      if (res < 0 && errno != EINTR)
+      {
+         fprintf(stderr, "Error: poll failed (%d / %s)\n", errno, strerror(errno));
+         return fail;
+      }
+
+      // (3) dispatch. a resumed task may disconnect/reconnect channels,
+      //     so check the connection is still the one we polled
+
+      for (size_t i= 0; res > 0 && i < fds.size(); i++)
+      {
+         AsyncRConChannel* channel= polled[i];
+
+         if (!fds[i].revents || channel->generation != generations[i])
+            continue;
+
+         if (fds[i].revents & (POLLOUT | POLLERR | POLLHUP))
+            if (channel->onWritable() != success)
+               continue;
+
+         if (channel->generation == generations[i] && fds[i].revents & (POLLIN | POLLERR | POLLHUP))
+            channel->onReadable();
+      }
+
+      // (4) timers and command timeouts
+
+      processTimers();
+   }
+
+   return done;
+}
+
+//***************************************************************************
+// class AsyncRConChannel
+//***************************************************************************
+// ctor/dtor
+//***************************************************************************
+
+AsyncRConChannel::AsyncRConChannel(EventLoop* aLoop)
+{
+   loop= aLoop;
+   state= csClosed;
+   rsock= na;
+   generation= 0;
+   timeout= 10;
+   busy= no;
+   result= success;
+   deadline= 0;
+   outPos= 0;
+   inLen= 0;
+   inBuffer.resize(BUFFSIZE_DEF);
+}
+
+AsyncRConChannel::~AsyncRConChannel()
+{
+   disconnect();
+}
+
+//***************************************************************************
+// connect
+//***************************************************************************
+
+AsyncRConChannel::Awaiter AsyncRConChannel::connect(const char* host, int port, const char* pass)
+{
+   Awaiter a= { this, fail };
+   AddressList addresses;
+
+   if (busy)
+      return a;
+
+   disconnect();
+
+   // resolver cache is shared with RConChannel, first address only
+
+   if (Resolver::lookup(host, port, &addresses) != success)
+      return a;
+
+   rsock= socket(addresses[0].family, SOCK_STREAM, IPPROTO_TCP);
+
+   if (rsock < 0)
+   {
+      fprintf(stderr, "Error: Failed to create socket to host '%s' (%d / %s)\n",
+            host ? host : "", errno, strerror(errno));
+
+      rsock= na;
+      return a;
+   }
+
+   fcntl(rsock, F_SETFL, fcntl(rsock, F_GETFL, 0) | O_NONBLOCK);
+
+   if (::connect(rsock, (sockaddr*)&addresses[0].addr, addresses[0].len) != 0 && errno != EINPROGRESS)
+   {
+      fprintf(stderr, "Error: Failed to connect to host '%s' (%d / %s)\n",
+            host ? host : "", errno, strerror(errno));
+
+      disconnect();
+      return a;
+   }
+
+   // auth packet is sent once the connection is established
+
+   state= csConnecting;
+   queuePacket(RC_PID, RC_AUTHENTICATE, pass);
+
+   busy= yes;
+   deadline= msNow() + timeout * 1000;
+   loop->watch(this);
+
+   a.res= success;
+   return a;
+}
+
+//***************************************************************************
+// disconnect
+//***************************************************************************
+
+int AsyncRConChannel::disconnect()
+{
+   if (rsock != na)
+      ::close(rsock);
+
+   rsock= na;
+   generation++;
+   state= csClosed;
+   outBuffer.clear();
+   outPos= 0;
+   inLen= 0;
+   loop->unwatch(this);
+
+   return done;
+}
+
+//***************************************************************************
+// command
+//***************************************************************************
+
+AsyncRConChannel::Awaiter AsyncRConChannel::command(const char* command)
+{
+   Awaiter a= { this, fail };
+
+   if (busy || state != csReady)
+      return a;
+
+   if (queuePacket(RC_PID, RC_COMMAND, command) != success)
+      return a;
+
+   busy= yes;
+   deadline= msNow() + timeout * 1000;
+
+   a.res= success;
+   return a;
+}
+
+//***************************************************************************
+// queue packet
+//***************************************************************************
+
+int AsyncRConChannel::queuePacket(int id, int cmd, const char* body)
+{
+   int bodyLen= strlen(body);
+   int size= sizeof(int) * 2 + bodyLen + 2;
+
+   if (size > BUFFSIZE_MAX)
+      return fail;
+
+   // same layout as RConChannel::send()
+
+   if (outPos == outBuffer.size())
+   {
+      outBuffer.clear();
+      outPos= 0;
+   }
+
+   outBuffer.append((const char*)&size, sizeof(int));
+   outBuffer.append((const char*)&id, sizeof(int));
+   outBuffer.append((const char*)&cmd, sizeof(int));
+   outBuffer.append(body, bodyLen);
+   outBuffer.append(2, '\0');
+
+   return success;
+}
+
+//***************************************************************************
+// events
+//***************************************************************************
+
+int AsyncRConChannel::events()
+{
+   if (state == csConnecting || outPos < outBuffer.size())
+      return POLLIN | POLLOUT;
+
+   return POLLIN;
+}
+
+//***************************************************************************
+// on writable
+//***************************************************************************
+
+int AsyncRConChannel::onWritable()
+{
+   if (state == csConnecting)
+   {
+      int err= 0;
+      socklen_t len= sizeof(err);
+
+      getsockopt(rsock, SOL_SOCKET, SO_ERROR, &err, &len);
+
+      if (err)
+      {
+         fprintf(stderr, "Error: Failed to connect (%d / %s)\n", err, strerror(err));
+         disconnect();
+         complete(fail);
+         return fail;
+      }
+
+      state= csAuthenticating;
+   }
+
+   while (outPos < outBuffer.size())
+   {
+      ssize_t res= ::send(rsock, outBuffer.data() + outPos, outBuffer.size() - outPos, 0);
+
+      if (res < 0 && (errno == EAGAIN || errno == EWOULDBLOCK))
+         break;
+
+      if (res < 0)
+      {
+         fprintf(stderr, "Error: Failed to send bytes (%d / %s)\n", errno, strerror(errno));
+         disconnect();
+         complete(fail);
+         return fail;
+      }
+
+      outPos+= res;
+   }
+
+   return success;
+}
+
+//***************************************************************************
+// on readable
+//***************************************************************************
+
+int AsyncRConChannel::onReadable()
+{
+   int gen= generation;
+
+   // completing a command resumes its task, which may disconnect or
+   // reconnect this channel. stop as soon as 'generation' changed
+
+   while (generation == gen)
+   {
+      if (inBuffer.size() - inLen < 4096)
+         inBuffer.resize(inBuffer.size() * 2);
+
+      ssize_t res= ::recv(rsock, &inBuffer[inLen], inBuffer.size() - inLen, 0);
+
+      if (res < 0 && (errno == EAGAIN || errno == EWOULDBLOCK))
+         break;
+
+      if (res <= 0)
+      {
+         if (res < 0)
+            fprintf(stderr, "Error: Failed to receive bytes (%d / %s)\n", errno, strerror(errno));
+
+         disconnect();
+         complete(fail);
+         return fail;
+      }
+
+      inLen+= res;
+
+      // (2) split complete packets: size, id, cmd, body
+
+      size_t pos= 0;
+
+      while (generation == gen && inLen - pos >= sizeof(int))
+      {
+         int size;
+         memcpy(&size, &inBuffer[pos], sizeof(int));
+
+         if (size < 10 || size > BUFFSIZE_MAX)
+         {
+            fprintf(stderr, "Error: invalid packet size (%d)\n", size);
+            disconnect();
+            complete(fail);
+            return fail;
+         }
+
+         if (inLen - pos < sizeof(int) + size)
+            break;
+
+         int id, cmd;
+         memcpy(&id, &inBuffer[pos + sizeof(int)], sizeof(int));
+         memcpy(&cmd, &inBuffer[pos + 2*sizeof(int)], sizeof(int));
+
+         onPacket(id, cmd, &inBuffer[pos + 3*sizeof(int)], size - 2*sizeof(int));
+         pos+= sizeof(int) + size;
+      }
+
+      if (generation != gen)
+         return fail;
+
+      if (pos)
+      {
+         memmove(&inBuffer[0], &inBuffer[pos], inLen - pos);
+         inLen-= pos;
+      }
+   }
+
+   return success;
+}
+
+//***************************************************************************
+// on packet
+//***************************************************************************
+
+int AsyncRConChannel::onPacket(int id, int cmd, const char* body, int bodyLen)
+{
+   if (!busy)
+      return done;           // unsolicited, ignore
+
+   reply.resize(bodyLen + 1);
+   reply.size= bodyLen + 2*sizeof(int);
+   reply.id= id;
+   reply.cmd= cmd;
+   memcpy(reply.data, body, bodyLen);
+   reply.data[bodyLen]= 0;
+
+   if (state == csAuthenticating)
+   {
+      if (id == -1)
+      {
+         disconnect();
+         complete(fail);
+         return fail;
+      }
+
+      state= csReady;
+      complete(success);
+      return done;
+   }
+
+   // same evaluation as RConChannel::sendCommand()
+
+   if (id != RC_PID)
+      complete(errWrongSequence);
+   else if (reply.size <= 10)
+      complete(wrnNoResponse);
+   else
+   {
+      char* t= reply.data + strlen(reply.data);
+
+      while (!*t && (t-reply.data))
+         t--;
+
+      while ((*t == ' ' || *t == '\n' || *t == '\r') && (t-reply.data))
+         *t--= 0;
+
+      if (!strcmp(reply.data, "Server received, But no response!!"))
+         complete(wrnNoResponse);
+      else
+         complete(success);
+   }
+
+   return done;
+}
+
+//***************************************************************************
+// complete
+//***************************************************************************
+
+void AsyncRConChannel::complete(int res)
+{
+   std::coroutine_handle<> h= waiter;
+
+   if (!busy)
+      return;
+
+   busy= no;
+   result= res;
+   waiter= 0;
+
+   if (h)
+      loop->resume(h);
+}
@@ -0,0 +1,190 @@
+//***************************************************************************
+// File asyncchannel.hpp
+// Date 18.10.26 - #1
+// Copyright (c) 2017-2026 s710 (s710 (at) posteo (dot) de). All rights reserved.
+// --------------------------------------------------------------------------
+// Ark ClusterChat / coroutine based (non-blocking) RCON client
+//***************************************************************************
+
+#ifndef __ASYNCCHANNEL_HPP__
+#define __ASYNCCHANNEL_HPP__
+
+#include <coroutine>
+#include <vector>
+#include <list>
+#include <string>
+
+#include "def.h"
+#include "channel.hpp"
+
+class EventLoop;
+class AsyncRConChannel;
+
+//***************************************************************************
+// struct AsyncTask
+//***************************************************************************
+// coroutine handed to EventLoop::spawn(). tasks co_await channel operations
+// and sleeps only, the loop destroys them once finished.
+//
+//   AsyncTask poll(AsyncRConChannel* channel)
+//   {
+//      int res= co_await channel->connect("myhost", 32330, "pass");
+//
+//      while (res != fail)
+//      {
+//         res= co_await channel->command("GetChat");
+//         co_await channel->getLoop()->sleep(1000);
+//      }
+//   }
+//***************************************************************************
+
+struct AsyncTask
+{
+   struct promise_type
+   {
+      AsyncTask get_return_object() { return AsyncTask(std::coroutine_handle<promise_type>::from_promise(*this)); }
+      std::suspend_always initial_suspend() noexcept { return {}; }
+      std::suspend_always final_suspend() noexcept { return {}; }
+      void return_void() {}
+      void unhandled_exception() { throw; }
+   };
+
+   explicit AsyncTask(std::coroutine_handle<promise_type> h) : handle(h) {}
+
+   std::coroutine_handle<promise_type> handle;
+};
+
+//***************************************************************************
+// class EventLoop
+//***************************************************************************
+// single threaded poll() loop. run one loop per thread to multiplex
+// thousands of channels on a few threads.
+//***************************************************************************
+
+class EventLoop
+{
+   friend class AsyncRConChannel;
+
+   public:
+
+      struct SleepAwaiter
+      {
+         EventLoop* loop;
+         int ms;
+
+         bool await_ready() { return ms <= 0; }
+         void await_suspend(std::coroutine_handle<> h);
+         void await_resume() {}
+      };
+
+      EventLoop();
+      ~EventLoop();
+
+      void spawn(AsyncTask task);
+      int run();
+      void stop() { stopped= yes; }
+
+      SleepAwaiter sleep(int ms) { return SleepAwaiter{this, ms}; }
+      int getTaskCount() { return tasks; }
+
+   protected:
+
+      struct Timer
+      {
+         unsigned long long due;
+         std::coroutine_handle<> handle;
+      };
+
+      static bool timerLater(const Timer& a, const Timer& b) { return a.due > b.due; }
+
+      void resume(std::coroutine_handle<> h);
+      void watch(AsyncRConChannel* channel);
+      void unwatch(AsyncRConChannel* channel);
+      int nextTimeout();
+      void processTimers();
+
+      std::vector<AsyncRConChannel*> channels;
+      std::vector<Timer> timers;                  // min heap on 'due'
+      std::list<std::coroutine_handle<> > ready;
+      int tasks;
+      volatile int stopped;
+};
+
+//***************************************************************************
+// class AsyncRConChannel
+//***************************************************************************
+// same protocol and return codes as RConChannel, but connect() and
+// command() are awaitables which suspend the calling task until the
+// reply arrived:
+//
+//   int res= co_await channel->command("GetChat");
+//
+// reply is found in getBuffer() afterwards (until next command).
+// one command may be outstanding per channel at a time.
+//***************************************************************************
+
+class AsyncRConChannel
+{
+   friend class EventLoop;
+
+   public:
+
+      struct Awaiter
+      {
+         AsyncRConChannel* channel;
+         int res;
+
+         bool await_ready() { return res != success; }     // failed immediately
+         void await_suspend(std::coroutine_handle<> h) { channel->waiter= h; }
+         int await_resume() { return res != success ? res : channel->result; }
+      };
+
+      AsyncRConChannel(EventLoop* aLoop);
+      ~AsyncRConChannel();
+
+      Awaiter connect(const char* host, int port, const char* pass);
+      Awaiter command(const char* command);
+      int disconnect();
+
+      void setTimeout(int seconds) { timeout= seconds; }
+      int isConnected() { return state == csReady; }
+
+      char* getBuffer() { return reply.getBuffer(); }
+      EventLoop* getLoop() { return loop; }
+
+   protected:
+
+      enum ChannelState
+      {
+         csClosed,
+         csConnecting,
+         csAuthenticating,
+         csReady
+      };
+
+      int queuePacket(int id, int cmd, const char* body);
+      int onWritable();
+      int onReadable();
+      int onPacket(int id, int cmd, const char* body, int bodyLen);
+      void complete(int res);
+      int events();
+
+      EventLoop* loop;
+      ChannelState state;
+      int rsock;
+      int generation;               // incremented on each disconnect
+      int timeout;                  // [s]
+      int busy;                     // command outstanding
+      int result;
+      unsigned long long deadline;  // [ms]
+      std::coroutine_handle<> waiter;
+
+      std::string outBuffer;
+      size_t outPos;
+      std::vector<char> inBuffer;
+      size_t inLen;
+      RConPacket reply;
+};
+
+//***************************************************************************
+#endif // __ASYNCCHANNEL_HPP__
@@ -0,0 +1,334 @@
+//***************************************************************************
+// File benchasync.cc
+// Date 18.10.26 - #1
+// Copyright (c) 2017-2026 s710 (s710 (at) posteo (dot) de). All rights reserved.
+// --------------------------------------------------------------------------
+// Ark ClusterChat / benchmark: coroutine client vs. thread per channel
+//***************************************************************************
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <signal.h>
+#include <sys/wait.h>
+#include <sys/resource.h>
+#include <vector>
+#include <algorithm>
+
+#include "def.h"
+#include "thread.hpp"
+#include "channel.hpp"
+#include "asyncchannel.hpp"
+#include "mockrcon.hpp"
+
+//***************************************************************************
+// globals
+//***************************************************************************
+
+#define MOCK_SERVERS 4
+#define CHAT "Player (Survivor): hello cluster\nPlayer2 (Dodo): hi there\n"
+
+static int servers= 500;
+static int seconds= 5;
+static int loops= 4;
+static int ports[MOCK_SERVERS];
+static volatile unsigned long long deadline= 0;
+
+//***************************************************************************
+// memory usage [kB]
+//***************************************************************************
+
+static long memUsage(const char* key)
+{
+   char line[256];
+   long res= 0;
+   FILE* f= fopen("/proc/self/status", "r");
+
+   if (!f)
+   {
+      // no procfs (MacOS), fall back to peak RSS
+
+      struct rusage usage;
+      getrusage(RUSAGE_SELF, &usage);
+      return !strcmp(key, "VmRSS:") ? usage.ru_maxrss / 1024 : 0;
+   }
+
+   while (fgets(line, sizeof(line), f))
+      if (!strncmp(line, key, strlen(key)))
+         res= atol(line + strlen(key));
+
+   fclose(f);
+
+   return res;
+}
+
+//***************************************************************************
+// class BlockingClient - the current model, one thread per channel
+//***************************************************************************
+
+class BlockingClient : public Thread
+{
+   public:
+
+      BlockingClient(int aPort) { port= aPort; commands= 0; }
+      unsigned long long commands;
+
+   protected:
+
+      int init()  { return channel.connect("127.0.0.1", port, "bench"); }
+      int exit()  { return channel.disconnect(); }
+
+      int run()
+      {
+         while (msNow() < deadline)
+         {
+            if (channel.sendCommand("GetChat") == fail)
+               return fail;
+
+            if (channel.sendCommand("ServerChat [Bench] Player (Survivor): hello cluster") == fail)
+               return fail;
+
+            commands+= 2;
+         }
+
+         return done;
+      }
+
+      RConChannel channel;
+      int port;
+};
+
+//***************************************************************************
+// class AsyncLoop - coroutine model, many channels per thread
+//***************************************************************************
+
+class AsyncLoop : public Thread
+{
+   public:
+
+      AsyncLoop() { commands= 0; }
+
+      ~AsyncLoop()
+      {
+         for (size_t i= 0; i < channels.size(); i++)
+            delete channels[i];
+      }
+
+      void add(int port)
+      {
+         AsyncRConChannel* channel= new AsyncRConChannel(&loop);
+
+         channels.push_back(channel);
+         loop.spawn(client(channel, port));
+      }
+
+      unsigned long long commands;
+
+   protected:
+
+      AsyncTask client(AsyncRConChannel* channel, int port)
+      {
+         int res= co_await channel->connect("127.0.0.1", port, "bench");
+
+         while (res == success && msNow() < deadline)
+         {
+            res= co_await channel->command("GetChat");
+
+            if (res != fail)
+               res= co_await channel->command("ServerChat [Bench] Player (Survivor): hello cluster");
+
+            if (res != fail)
+            {
+               commands+= 2;
+               res= success;
+            }
+         }
+      }
+
+      int run() { return loop.run(); }
+
+      EventLoop loop;
+      std::vector<AsyncRConChannel*> channels;
+};
+
+//***************************************************************************
+// bench thread model
+//***************************************************************************
+
+static int benchThreads()
+{
+   std::vector<BlockingClient*> clients;
+   unsigned long long commands= 0;
+   long rss= memUsage("VmRSS:"), vsz= memUsage("VmSize:");
+   long rssUsed= 0, vszUsed= 0;
+
+   deadline= msNow() + 1000 * seconds + 60000;   // adjusted once all are connected
+
+   for (int i= 0; i < servers; i++)
+   {
+      BlockingClient* client= new BlockingClient(ports[i % MOCK_SERVERS]);
+      clients.push_back(client);
+
+      if (client->start(10) != success)
+      {
+         fprintf(stderr, "Error: Failed to start client %d\n", i);
+         return fail;
+      }
+   }
+
+   // clients are already busy, only count what happens from now on
+
+   unsigned long long start= msNow();
+   deadline= start + 1000 * seconds;
+
+   for (size_t i= 0; i < clients.size(); i++)
+      commands-= clients[i]->commands;
+
+   while (msNow() < deadline)
+   {
+      usleep(100000);
+      rssUsed= std::max(rssUsed, memUsage("VmRSS:") - rss);
+      vszUsed= std::max(vszUsed, memUsage("VmSize:") - vsz);
+   }
+
+   for (size_t i= 0; i < clients.size(); i++)
+   {
+      clients[i]->stop();
+      commands+= clients[i]->commands;
+      delete clients[i];
+   }
+
+   unsigned long long elapsed= msNow() - start;
+
+   printf("thread  servers %4d  threads %4d  %10.0f cmd/s  rss %7ld kB  vsz %9ld kB\n",
+          servers, servers, commands * 1000.0 / elapsed, rssUsed, vszUsed);
+
+   return done;
+}
+
+//***************************************************************************
+// bench coroutine model
+//***************************************************************************
+
+static int benchCoroutines()
+{
+   std::vector<AsyncLoop*> threads;
+   unsigned long long commands= 0;
+   long rss= memUsage("VmRSS:"), vsz= memUsage("VmSize:");
+   long rssUsed= 0, vszUsed= 0;
+
+   for (int i= 0; i < loops; i++)
+      threads.push_back(new AsyncLoop);
+
+   for (int i= 0; i < servers; i++)
+      threads[i % loops]->add(ports[i % MOCK_SERVERS]);
+
+   unsigned long long start= msNow();
+   deadline= start + 1000 * seconds;
+
+   for (int i= 0; i < loops; i++)
+      threads[i]->start();
+
+   while (msNow() < deadline)
+   {
+      usleep(100000);
+      rssUsed= std::max(rssUsed, memUsage("VmRSS:") - rss);
+      vszUsed= std::max(vszUsed, memUsage("VmSize:") - vsz);
+   }
+
+   for (size_t i= 0; i < threads.size(); i++)
+   {
+      threads[i]->stop();
+      commands+= threads[i]->commands;
+      delete threads[i];
+   }
+
+   unsigned long long elapsed= msNow() - start;
+
+   printf("coro    servers %4d  threads %4d  %10.0f cmd/s  rss %7ld kB  vsz %9ld kB\n",
+          servers, loops, commands * 1000.0 / elapsed, rssUsed, vszUsed);
+
+   return done;
+}
+
+//***************************************************************************
+// run mode in child process, to measure memory separately
+//***************************************************************************
+
+static int runForked(int (*bench)())
+{
+   int status= 0;
+   pid_t pid= ::fork();
+
+   if (!pid)
+   {
+      int res= bench();
+
+      fflush(stdout);
+      ::_exit(res == success ? 0 : 1);
+   }
+
+   waitpid(pid, &status, 0);
+
+   return WIFEXITED(status) && !WEXITSTATUS(status) ? success : fail;
+}
+
+//***************************************************************************
+// main
+//***************************************************************************
+
+int main(int argc, char* argv[])
+{
+   const char* mode= "both";
+   MockRConServer mock[MOCK_SERVERS];
+   struct rlimit limit;
+
+   for (int i= 1; i < argc; i++)
+   {
+      if (!strcmp(argv[i], "--servers") && argv[i+1])
+         servers= atoi(argv[++i]);
+      else if (!strcmp(argv[i], "--seconds") && argv[i+1])
+         seconds= atoi(argv[++i]);
+      else if (!strcmp(argv[i], "--loops") && argv[i+1])
+         loops= atoi(argv[++i]);
+      else if (!strcmp(argv[i], "--mode") && argv[i+1])
+         mode= argv[++i];
+      else
+      {
+         printf("Usage: benchasync [--servers N] [--seconds S] [--loops L] [--mode thread|coro|both]\n");
+         return 1;
+      }
+   }
+
+   if (servers < 1 || loops < 1 || seconds < 1)
+      return 1;
+
+   // client + server socket per simulated server
+
+   getrlimit(RLIMIT_NOFILE, &limit);
+   limit.rlim_cur= limit.rlim_max;
+   setrlimit(RLIMIT_NOFILE, &limit);
+   signal(SIGPIPE, SIG_IGN);
+
+   for (int i= 0; i < MOCK_SERVERS; i++)
+   {
+      mock[i].setChat(CHAT);
+
+      if (mock[i].open(0) != success)
+         return 1;
+
+      ports[i]= mock[i].getPort();
+   }
+
+   printf("Benchmark: %d simulated servers, %d s, GetChat + ServerChat per cycle\n", servers, seconds);
+   fflush(stdout);
+
+   if (strcmp(mode, "coro"))
+      runForked(benchThreads);
+
+   if (strcmp(mode, "thread"))
+      runForked(benchCoroutines);
+
+   return 0;
+}
@@ -0,0 +1,216 @@
+//***************************************************************************
+// File benchfilter.cc
+// Date 18.10.26 - #1
+// Copyright (c) 2017-2026 s710 (s710 (at) posteo (dot) de). All rights reserved.
+// --------------------------------------------------------------------------
+// Ark ClusterChat / benchmark: keyword filter throughput
+//***************************************************************************
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <vector>
+#include <string>
+#include <algorithm>
+
+#include "def.h"
+#include "thread.hpp"
+#include "filter.hpp"
+
+//***************************************************************************
+// globals
+//***************************************************************************
+
+static const char* chatWords[]=
+{
+   "hello", "anyone", "selling", "rex", "saddle", "for", "metal", "need", "help", "with",
+   "taming", "giga", "at", "the", "volcano", "lol", "gg", "tribe", "recruiting", "pvp",
+   "base", "raid", "tonight", "who", "has", "spare", "cryopods", "trade", "eggs", "wyvern",
+   0
+};
+
+static const char* adWords[]= { "discord.gg/", "www.", "cheap-ark-items", "free dinos", 0 };
+
+static unsigned int seed= 42;
+static int seconds= 2;
+
+//***************************************************************************
+// synthetic word list, pronounceable 5-10 character words
+//***************************************************************************
+
+static std::string randomWord()
+{
+   static const char* consonants= "bcdfghjklmnprstvwz";
+   static const char* vowels= "aeiou";
+   std::string res;
+   int len= 5 + rand_r(&seed) % 6;
+
+   for (int i= 0; i < len; i++)
+      res+= i % 2 ? vowels[rand_r(&seed) % 5] : consonants[rand_r(&seed) % 18];
+
+   return res;
+}
+
+//***************************************************************************
+// messages, ~1% of the words are listed ones
+//***************************************************************************
+
+static std::vector<std::string> makeMessages(const std::vector<std::string>& words, int count)
+{
+   std::vector<std::string> res;
+   int nChat= 0;
+
+   while (chatWords[nChat])
+      nChat++;
+
+   for (int m= 0; m < count; m++)
+   {
+      std::string msg= "PlayerName (Survivor): ";
+      int n= 4 + rand_r(&seed) % 12;
+
+      for (int i= 0; i < n; i++)
+      {
+         if (i)
+            msg+= ' ';
+
+         if (!(rand_r(&seed) % 100))
+            msg+= words[rand_r(&seed) % words.size()];
+         else
+            msg+= chatWords[rand_r(&seed) % nChat];
+      }
+
+      res.push_back(msg);
+   }
+
+   return res;
+}
+
+//***************************************************************************
+// bench
+//***************************************************************************
+
+static void bench(const std::vector<std::string>& words, int patterns, int naive)
+{
+   KeywordFilter filter;
+   std::vector<std::string> subset(words.begin(), words.begin() + patterns);
+   std::vector<std::string> messages= makeMessages(subset, 10000);
+   unsigned long long count= 0, hits= 0, bytes= 0;
+   unsigned long long start= msNow(), elapsed;
+
+   for (size_t i= 0; i < subset.size(); i++)
+      filter.add(subset[i].c_str(), subset[i].size());
+
+   filter.build();
+
+   while ((elapsed= msNow() - start) < 1000ULL * seconds)
+   {
+      for (size_t i= 0; i < messages.size(); i++, count++)
+      {
+         bytes+= messages[i].size();
+         hits+= filter.match(messages[i].c_str(), messages[i].size());
+      }
+   }
+
+   printf("aho-corasick  patterns %6d  states %7d  %10.0f msg/s  %7.1f MB/s  hits %4.1f%%\n",
+          patterns, filter.getStates(), count * 1000.0 / elapsed, bytes / 1000.0 / elapsed,
+          100.0 * hits / count);
+
+   if (!naive)
+      return;
+
+   // what a strcasestr() per word would cost
+
+   count= hits= 0;
+   start= msNow();
+
+   while ((elapsed= msNow() - start) < 1000ULL * seconds)
+   {
+      for (size_t i= 0; i < messages.size(); i++, count++)
+      {
+         for (size_t w= 0; w < subset.size(); w++)
+         {
+            if (strcasestr(messages[i].c_str(), subset[w].c_str()))
+            {
+               hits++;
+               break;
+            }
+         }
+      }
+   }
+
+   printf("strcasestr    patterns %6d                  %10.0f msg/s               hits %4.1f%%\n",
+          patterns, count * 1000.0 / elapsed, 100.0 * hits / count);
+}
+
+//***************************************************************************
+// main
+//***************************************************************************
+
+int main(int argc, char* argv[])
+{
+   std::vector<std::string> words;
+   const char* file= 0;
+   int maxPatterns= 10000;
+
+   for (int i= 1; i < argc; i++)
+   {
+      if (!strcmp(argv[i], "--words") && argv[i+1])
+         file= argv[++i];
+      else if (!strcmp(argv[i], "--patterns") && argv[i+1])
+         maxPatterns= atoi(argv[++i]);
+      else if (!strcmp(argv[i], "--seconds") && argv[i+1])
+         seconds= atoi(argv[++i]);
+      else
+      {
+         printf("Usage: benchfilter [--words FILE] [--patterns N] [--seconds S]\n");
+         return 1;
+      }
+   }
+
+   if (file)
+   {
+      char line[1024];
+      FILE* f= fopen(file, "r");
+
+      if (!f)
+      {
+         fprintf(stderr, "Error: Failed to open '%s'\n", file);
+         return 1;
+      }
+
+      while (fgets(line, sizeof(line), f))
+      {
+         line[strcspn(line, "\r\n")]= 0;
+
+         if (*line && *line != '#')
+            words.push_back(line);
+      }
+
+      fclose(f);
+   }
+   else
+   {
+      for (int i= 0; adWords[i]; i++)
+         words.push_back(adWords[i]);
+
+      while ((int)words.size() < maxPatterns)
+         words.push_back(randomWord());
+   }
+
+   if (words.empty() || maxPatterns < 1)
+      return 1;
+
+   printf("Benchmark: keyword filter, %d s per run, %s word list\n", seconds, file ? file : "synthetic");
+
+   for (int patterns= 10; ; patterns*= 10)
+   {
+      int n= std::min(patterns, std::min(maxPatterns, (int)words.size()));
+
+      bench(words, n, n <= 1000);
+
+      if (n == maxPatterns || n == (int)words.size())
+         break;
+   }
+
+   return 0;
+}
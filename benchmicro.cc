@@ -0,0 +1,497 @@
+//***************************************************************************
+// File benchmicro.cc
+// Date 18.10.26 - #1
+// Copyright (c) 2017-2026 s710 (s710 (at) posteo (dot) de). All rights reserved.
+// --------------------------------------------------------------------------
+// Ark ClusterChat / microbenchmarks: packet codec, queue, fan-out, format
+//***************************************************************************
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <pthread.h>
+#include <sched.h>
+#include <sys/socket.h>
+#include <atomic>
+#include <new>
+#include <list>
+#include <vector>
+#include <string>
+#include <algorithm>
+#include <type_traits>
+
+#include "def.h"
+#include "thread.hpp"
+#include "channel.hpp"
+#include "rconthread.hpp"
+#include "format.hpp"
+#include "rules.hpp"
+#include "trace.hpp"
+
+//***************************************************************************
+// globals
+//***************************************************************************
+
+#define LINE "[Global] Player42 (Survivor): anyone selling a rex saddle? paying metal"
+
+static int minMs= 200;           // per measurement
+static int runs= 5;              // median of
+static const char* only= 0;      // name filter
+static int json= no;
+
+//***************************************************************************
+// allocation counting
+//***************************************************************************
+// every operator new of the process, std containers and strings included.
+// malloc() calls (RConPacket, strdup) are not counted
+//***************************************************************************
+
+static std::atomic<unsigned long long> allocations(0);
+
+void* operator new(size_t size)
+{
+   void* p= malloc(size ? size : 1);
+
+   if (!p)
+      throw std::bad_alloc();
+
+   allocations.fetch_add(1, std::memory_order_relaxed);
+
+   return p;
+}
+
+void operator delete(void* p) noexcept             { free(p); }
+void operator delete(void* p, size_t) noexcept     { free(p); }
+
+//***************************************************************************
+// measure
+//***************************************************************************
+
+struct Result
+{
+   std::string name;
+   int param;
+   double nsPerOp;
+   double allocsPerOp;
+   unsigned long long ops;
+};
+
+static std::vector<Result> results;
+
+template<class F>
+static double timed(F& fn, unsigned long long n)
+{
+   // [ns] of fn(n), functions with a setup of their own (threads, ...)
+   // return the time of the part to measure themselves
+
+   if constexpr (std::is_void<decltype(fn(n))>::value)
+   {
+      unsigned long long start= Trace::nsNow();
+      fn(n);
+      return Trace::nsNow() - start;
+   }
+   else
+      return fn(n);
+}
+
+template<class F>
+static void measure(const char* name, int param, F fn, unsigned long long minOps= 1)
+{
+   // grow the iteration count until one run takes minMs, then take the
+   // median of 'runs' runs
+
+   std::vector<std::pair<double, double> > samples;
+   unsigned long long n= minOps;
+
+   if (only && !strstr(name, only))
+      return;
+
+   for (;;)
+   {
+      double ns= timed(fn, n);
+
+      if (ns >= minMs * 1000000ULL / 4)
+      {
+         n= (unsigned long long)(n * (minMs * 1000000.0 / ns)) + 1;
+         break;
+      }
+
+      n*= 4;
+   }
+
+   for (int r= 0; r < runs; r++)
+   {
+      unsigned long long allocs= allocations.load();
+      double ns= timed(fn, n);
+
+      samples.push_back(std::make_pair(ns / n, (double)(allocations.load() - allocs) / n));
+   }
+
+   std::sort(samples.begin(), samples.end());
+
+   Result res= { name, param, samples[runs / 2].first, samples[runs / 2].second, n };
+   results.push_back(res);
+
+   if (!json)
+   {
+      printf("%-28s %6d %12.1f %12.2f %12llu\n", name, param, res.nsPerOp, res.allocsPerOp, n);
+      fflush(stdout);
+   }
+}
+
+//***************************************************************************
+// class BenchChannel - RConChannel on one end of a socketpair
+//***************************************************************************
+
+class BenchChannel : public RConChannel
+{
+   public:
+
+      ~BenchChannel() { rsock= na; }
+
+      void setSocket(int sock) { rsock= sock; }
+      int encode(const char* command) { return send(RC_PID, RC_COMMAND, command); }
+      int decode() { return receive(); }
+};
+
+//***************************************************************************
+// packet codec
+//***************************************************************************
+
+static void benchCodec()
+{
+   int fds[2];
+   BenchChannel a, b;
+   std::string chat;
+
+   if (socketpair(AF_UNIX, SOCK_STREAM, 0, fds))
+      return;
+
+   a.setSocket(fds[0]);
+   b.setSocket(fds[1]);
+
+   // a ServerChat command and a full GetChat response
+
+   while (chat.size() < RCON_PACKET_MAX - 100)
+      chat.append(LINE "\n");
+
+   const char* bodies[]= { "ServerChat [TheIsland] " LINE, chat.c_str() };
+
+   for (int i= 0; i < 2; i++)
+   {
+      const char* body= bodies[i];
+
+      measure("packet send+receive", strlen(body), [&](unsigned long long n)
+      {
+         for (unsigned long long k= 0; k < n; k++)
+         {
+            a.encode(body);
+            b.decode();
+         }
+      });
+   }
+
+   close(fds[0]);
+   close(fds[1]);
+}
+
+//***************************************************************************
+// work list, P producers and one consumer
+//***************************************************************************
+
+struct ProducerArgs
+{
+   WorkList* list;
+   std::shared_ptr<const Message> message;
+   unsigned long long count;
+   std::atomic<int>* go;
+};
+
+static void* produce(void* arg)
+{
+   ProducerArgs* args= (ProducerArgs*)arg;
+
+   while (!args->go->load())
+      sched_yield();
+
+   for (unsigned long long i= 0; i < args->count; i++)
+   {
+      Work* work= new Work;
+      work->message= args->message;
+      args->list->enqueue(work);
+   }
+
+   return 0;
+}
+
+static void benchWorkList()
+{
+   std::shared_ptr<Message> message= std::make_shared<Message>();
+
+   message->text= LINE;
+
+   for (int producers= 1; producers <= 64; producers*= 2)
+   {
+      // exactly n items over all producers, the clock starts once all
+      // threads are up
+
+      measure("worklist enqueue+dequeue", producers, [&](unsigned long long n) -> double
+      {
+         WorkList list;
+         std::vector<pthread_t> threads(producers);
+         std::vector<ProducerArgs> args(producers);
+         std::atomic<int> go(0);
+         unsigned long long got= 0;
+         Work* work;
+
+         for (int p= 0; p < producers; p++)
+         {
+            args[p].list= &list;
+            args[p].message= message;
+            args[p].count= n / producers + ((unsigned long long)p < n % producers ? 1 : 0);
+            args[p].go= &go;
+            pthread_create(&threads[p], 0, produce, &args[p]);
+         }
+
+         unsigned long long start= Trace::nsNow();
+         go= 1;
+
+         while (got < n)
+         {
+            if ((work= list.dequeue()))
+            {
+               delete work;
+               got++;
+            }
+         }
+
+         double ns= Trace::nsNow() - start;
+
+         for (int p= 0; p < producers; p++)
+            pthread_join(threads[p], 0);
+
+         return ns;
+      }, producers);
+   }
+}
+
+//***************************************************************************
+// class BenchThread - RConThread without connections, for relay()
+//***************************************************************************
+
+class BenchThread : public RConThread
+{
+   public:
+
+      BenchThread(std::list<RConThread*>* threads) : RConThread(threads) { map= strdup("TheIsland"); }
+
+      int fanOut(const char* text, int len) { return relay(text, len, lkChat, 0); }
+      int clear() { return queue.clear(); }
+};
+
+//***************************************************************************
+// fan-out of one line
+//***************************************************************************
+
+static void benchFanOut()
+{
+   const char* line= LINE;
+
+   for (int destinations= 2; destinations <= 128; destinations*= 4)
+   {
+      std::list<RConThread*> threads;
+      std::vector<BenchThread*> bench;
+
+      for (int i= 0; i <= destinations; i++)
+      {
+         BenchThread* t= new BenchThread(&threads);
+
+         t->setIndex(i);
+         threads.push_back(t);
+         bench.push_back(t);
+      }
+
+      measure("relay fan-out", destinations, [&](unsigned long long n)
+      {
+         for (unsigned long long k= 0; k < n; k++)
+         {
+            bench[0]->fanOut(line, strlen(line));
+
+            if (k % 64 == 63)
+               for (size_t i= 1; i < bench.size(); i++)
+                  bench[i]->clear();
+         }
+
+         for (size_t i= 1; i < bench.size(); i++)
+            bench[i]->clear();
+      });
+
+      for (size_t i= 0; i < bench.size(); i++)
+         delete bench[i];
+   }
+}
+
+//***************************************************************************
+// formatting of outbound commands
+//***************************************************************************
+
+static void benchFormat()
+{
+   Message message;
+   Commands commands;
+   const MessageFormat* plain= MessageFormat::get(DEFAULT_FORMAT);
+   const MessageFormat* rich= MessageFormat::get("ServerChat <RichColor Color=\"1,0.5,0,1\">[{server}]</> {player} ({character}): {body}");
+
+   message.text= LINE;
+   message.server= "TheIsland";
+   message.line.parse(message.text.c_str(), message.text.length());
+
+   measure("format default", 0, [&](unsigned long long n)
+   {
+      for (unsigned long long k= 0; k < n; k++)
+         plain->format(&message, 0, &commands);
+   });
+
+   measure("format rich", 0, [&](unsigned long long n)
+   {
+      for (unsigned long long k= 0; k < n; k++)
+         rich->format(&message, 0, &commands);
+   });
+
+   // three parts
+
+   measure("format rich split", 40, [&](unsigned long long n)
+   {
+      for (unsigned long long k= 0; k < n; k++)
+         rich->format(&message, 40, &commands);
+   });
+}
+
+//***************************************************************************
+// routing by relay rules
+//***************************************************************************
+
+static int benchRules()
+{
+   // the rules are checked before they are measured, a rule set which
+   // compiles but never matches would be fast and useless
+
+   static const char* text=
+      "deny if body prefix \"!x\"\n"
+      "deny to Ragnarok if player is \"player42\" and not body contains \"REX SADDLE\"\n"
+      "deny to Valguero if player is \"player42\" and body contains \"rex saddle\"\n"
+      "allow\n";
+
+   static const struct { const char* line; const char* expected; } checks[]=
+   {
+      { "[Global] Player42 (Survivor): !xp please",   "" },
+      { "[Global] Player42 (Survivor): hello",        "TheIsland,Valguero" },
+      { LINE,                                         "TheIsland,Ragnarok" },
+      { "[Global] Player7 (Survivor): rex saddle?",   "TheIsland,Ragnarok,Valguero" }
+   };
+
+   const char* titles[]= { "TheIsland", "Ragnarok", "Valguero" };
+   char path[]= "/tmp/benchrules.XXXXXX";
+   int fd= mkstemp(path);
+   RuleSet rules;
+   ChatLine fields;
+   int res= success;
+
+   if (fd < 0 || write(fd, text, strlen(text)) != (ssize_t)strlen(text))
+      return fail;
+
+   close(fd);
+   RuleSet::setServers(std::vector<std::string>(titles, titles + 3));
+
+   if (rules.load(path) != success)
+      res= fail;
+
+   unlink(path);
+
+   for (size_t c= 0; res == success && c < sizeof(checks) / sizeof(checks[0]); c++)
+   {
+      std::string got;
+
+      fields.parse(checks[c].line, strlen(checks[c].line));
+      DestMask mask= rules.route(checks[c].line, &fields, 1);
+
+      for (int i= 0; i < 3; i++)
+         if (mask.test(i))
+            got+= std::string(got.empty() ? "" : ",") + titles[i];
+
+      if (got != checks[c].expected)
+      {
+         fprintf(stderr, "Error: Rules routed '%s' to '%s', expected '%s'\n", checks[c].line, got.c_str(), checks[c].expected);
+         res= fail;
+      }
+   }
+
+   if (res != success)
+      return res;
+
+   fields.parse(LINE, strlen(LINE));
+
+   measure("rules route", rules.getCount(), [&](unsigned long long n)
+   {
+      for (unsigned long long k= 0; k < n; k++)
+         rules.route(LINE, &fields, 1);
+   });
+
+   return success;
+}
+
+//***************************************************************************
+// main
+//***************************************************************************
+
+int main(int argc, char* argv[])
+{
+   for (int i= 1; i < argc; i++)
+   {
+      if (!strcmp(argv[i], "--ms") && argv[i+1])
+         minMs= atoi(argv[++i]);
+      else if (!strcmp(argv[i], "--runs") && argv[i+1])
+         runs= atoi(argv[++i]);
+      else if (!strcmp(argv[i], "--only") && argv[i+1])
+         only= argv[++i];
+      else if (!strcmp(argv[i], "--json"))
+         json= yes;
+      else
+      {
+         printf("Usage: benchmicro [--ms MS] [--runs N] [--only NAME] [--json]\n");
+         return 1;
+      }
+   }
+
+   if (minMs < 1 || runs < 1)
+      return 1;
+
+   if (!json)
+   {
+      printf("Benchmark: median of %d runs of at least %d ms each\n", runs, minMs);
+      printf("%-28s %6s %12s %12s %12s\n", "name", "param", "ns/op", "allocs/op", "ops/run");
+   }
+
+   benchCodec();
+   benchWorkList();
+   benchFanOut();
+   benchFormat();
+
+   if (benchRules() != success)
+      return 1;
+
+   if (json)
+   {
+      printf("{\"benchmarks\":[\n");
+
+      for (size_t i= 0; i < results.size(); i++)
+         printf("  {\"name\":\"%s\",\"param\":%d,\"ns_per_op\":%.2f,\"allocs_per_op\":%.3f,\"ops\":%llu}%s\n",
+                results[i].name.c_str(), results[i].param, results[i].nsPerOp, results[i].allocsPerOp,
+                results[i].ops, i + 1 < results.size() ? "," : "");
+
+      printf("]}\n");
+   }
+
+   return 0;
+}
@@ -0,0 +1,318 @@
+//***************************************************************************
+// File benchrelay.cc
+// Date 18.10.26 - #1
+// Copyright (c) 2017-2026 s710 (s710 (at) posteo (dot) de). All rights reserved.
+// --------------------------------------------------------------------------
+// Ark ClusterChat / load benchmark: relay against N mock servers
+//***************************************************************************
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <signal.h>
+#include <fcntl.h>
+#include <sys/wait.h>
+#include <sys/resource.h>
+#include <vector>
+#include <string>
+#include <algorithm>
+
+#include "def.h"
+#include "thread.hpp"
+#include "mockrcon.hpp"
+
+//***************************************************************************
+// globals
+//***************************************************************************
+
+#define MOCK_SERVERS 8
+
+static const char* relay= "./arkclusterchat";
+static const char* sizes= "2,8,32,128,512";
+static int seconds= 10;
+static int warmup= 3;
+static double rate= 0.5;
+static int latency= 0;
+static const char* faultSpec= 0;
+static int sick= 1;              // mocks injecting faults
+static std::vector<const char*> relayArgs;
+
+//***************************************************************************
+// process usage, cpu [ticks] and memory [kB] from procfs
+//***************************************************************************
+
+static unsigned long long cpuTicks(pid_t pid)
+{
+   char path[64], line[1024];
+   unsigned long long utime= 0, stime= 0;
+   FILE* f;
+
+   snprintf(path, sizeof(path), "/proc/%d/stat", pid);
+
+   if (!(f= fopen(path, "r")))
+      return 0;
+
+   // fields after the command name, which may contain spaces
+
+   if (fgets(line, sizeof(line), f) && strrchr(line, ')'))
+      sscanf(strrchr(line, ')') + 2, "%*c %*d %*d %*d %*d %*d %*u %*u %*u %*u %*u %llu %llu", &utime, &stime);
+
+   fclose(f);
+
+   return utime + stime;
+}
+
+static long memUsage(pid_t pid, const char* key)
+{
+   char path[64], line[256];
+   long res= 0;
+   FILE* f;
+
+   snprintf(path, sizeof(path), "/proc/%d/status", pid);
+
+   if (!(f= fopen(path, "r")))
+      return 0;
+
+   while (fgets(line, sizeof(line), f))
+      if (!strncmp(line, key, strlen(key)))
+         res= atol(line + strlen(key));
+
+   fclose(f);
+
+   return res;
+}
+
+//***************************************************************************
+// start relay
+//***************************************************************************
+
+static pid_t startRelay(int servers, int* ports)
+{
+   std::vector<std::string> args;
+   std::vector<char*> argv;
+   char server[100];
+   pid_t pid;
+
+   args.push_back(relay);
+
+   for (int i= 0; i < servers; i++)
+   {
+      snprintf(server, sizeof(server), "S%d:bench@127.0.0.1:%d", i, ports[i % MOCK_SERVERS]);
+      args.push_back("-s");
+      args.push_back(server);
+   }
+
+   for (size_t i= 0; i < relayArgs.size(); i++)
+      args.push_back(relayArgs[i]);
+
+   for (size_t i= 0; i < args.size(); i++)
+      argv.push_back((char*)args[i].c_str());
+
+   argv.push_back(0);
+
+   if (!(pid= ::fork()))
+   {
+      int null= ::open("/dev/null", O_WRONLY);
+
+      dup2(null, 1);
+      execv(relay, &argv[0]);
+      fprintf(stderr, "Error: Failed to start '%s'\n", relay);
+      ::_exit(1);
+   }
+
+   return pid;
+}
+
+//***************************************************************************
+// run one size
+//***************************************************************************
+
+static int bench(int servers, MockRConServer* mock, int* ports, int faulty)
+{
+   std::vector<unsigned> all, part;
+   unsigned long long ticks, start;
+   long hz= sysconf(_SC_CLK_TCK);
+   int status= 0;
+   int first= faultSpec ? sick : 0;     // first healthy mock
+   int healthy= 0;
+   MockFaults faults;
+
+   for (int i= 0; i < servers; i++)
+      healthy+= i % MOCK_SERVERS >= first;
+
+   faults.parse(faulty ? faultSpec : "");
+
+   for (int i= 0; i < sick; i++)
+      mock[i].setFaults(faults);
+
+   pid_t pid= startRelay(servers, ports);
+
+   if (pid <= 0)
+      return fail;
+
+   // connect and settle, then start measuring
+
+   sleep(warmup);
+
+   for (int i= 0; i < MOCK_SERVERS; i++)
+      mock[i].takeLatencies(&part);
+
+   ticks= cpuTicks(pid);
+   start= msNow();
+
+   sleep(seconds);
+
+   ticks= cpuTicks(pid) - ticks;
+   double elapsed= (msNow() - start) / 1000.0;
+   long rss= memUsage(pid, "VmRSS:");
+
+   for (int i= 0; i < MOCK_SERVERS; i++)
+   {
+      mock[i].takeLatencies(&part);
+
+      if (i >= first)
+         all.insert(all.end(), part.begin(), part.end());
+   }
+
+   // hung connections may keep the relay in its drain, don't wait for it
+
+   ::kill(pid, SIGINT);
+
+   for (int i= 0; i < 50 && !waitpid(pid, &status, WNOHANG); i++)
+      usleep(100000);
+
+   if (!waitpid(pid, &status, WNOHANG))
+   {
+      ::kill(pid, SIGKILL);
+      waitpid(pid, &status, 0);
+   }
+
+   std::sort(all.begin(), all.end());
+
+   double expected= rate * healthy * (healthy - 1);
+   double p50= all.size() ? all[all.size() / 2] / 1000.0 : 0;
+   double p99= all.size() ? all[all.size() * 99 / 100] / 1000.0 : 0;
+
+   printf("%6d %7s %12.0f %12.0f %10.1f %10.1f %8.1f %10.1f\n",
+          servers, faulty ? "yes" : "no", expected, all.size() / elapsed, p50, p99,
+          100.0 * ticks / hz / elapsed, rss / 1024.0);
+   fflush(stdout);
+
+   // relay exits with 2 if started with --alloc-limit and above it
+
+   if (WIFEXITED(status) && WEXITSTATUS(status) == 2)
+   {
+      printf("Error: Relay exceeded its allocation limit with %d servers\n", servers);
+      return fail;
+   }
+
+   return success;
+}
+
+//***************************************************************************
+// main
+//***************************************************************************
+
+int main(int argc, char* argv[])
+{
+   MockRConServer mock[MOCK_SERVERS];
+   int ports[MOCK_SERVERS];
+   struct rlimit limit;
+
+   for (int i= 1; i < argc; i++)
+   {
+      if (!strcmp(argv[i], "--servers") && argv[i+1])
+         sizes= argv[++i];
+      else if (!strcmp(argv[i], "--seconds") && argv[i+1])
+         seconds= atoi(argv[++i]);
+      else if (!strcmp(argv[i], "--warmup") && argv[i+1])
+         warmup= atoi(argv[++i]);
+      else if (!strcmp(argv[i], "--rate") && argv[i+1])
+         rate= atof(argv[++i]);
+      else if (!strcmp(argv[i], "--latency") && argv[i+1])
+         latency= atoi(argv[++i]);
+      else if (!strcmp(argv[i], "--relay") && argv[i+1])
+         relay= argv[++i];
+      else if (!strcmp(argv[i], "--faults") && argv[i+1])
+         faultSpec= argv[++i];
+      else if (!strcmp(argv[i], "--sick") && argv[i+1])
+         sick= atoi(argv[++i]);
+      else if (!strcmp(argv[i], "--"))
+      {
+         while (++i < argc)
+            relayArgs.push_back(argv[i]);
+      }
+      else
+      {
+         printf("Usage: benchrelay [--servers N,N,...] [--seconds S] [--warmup S] [--rate LINES/S]\n"
+                "                  [--latency MS] [--relay PATH] [--faults SPEC] [--sick MOCKS]\n"
+                "                  [-- RELAY OPTIONS]\n"
+                "Faults: delay=MS,stall=SEC:MS,reset=N,hang=N,partial=N,truncate=N,bogus=N,auth=N\n");
+         return 1;
+      }
+   }
+
+   if (seconds < 1 || rate <= 0 || sick < 1 || sick >= MOCK_SERVERS)
+      return 1;
+
+   if (faultSpec)
+   {
+      MockFaults faults;
+
+      if (faults.parse(faultSpec) != success)
+      {
+         printf("Error: Invalid fault spec '%s'\n", faultSpec);
+         return 1;
+      }
+   }
+
+   // server socket per simulated server
+
+   getrlimit(RLIMIT_NOFILE, &limit);
+   limit.rlim_cur= limit.rlim_max;
+   setrlimit(RLIMIT_NOFILE, &limit);
+   signal(SIGPIPE, SIG_IGN);
+
+   for (int i= 0; i < MOCK_SERVERS; i++)
+   {
+      mock[i].setChatRate(rate);
+
+      // lines of sick servers are not counted, with or without faults
+
+      if (faultSpec && i < sick)
+         mock[i].setSender("Sick");
+      mock[i].setReplyDelay(latency);
+
+      if (mock[i].open(0, "bench") != success)
+         return 1;
+
+      ports[i]= mock[i].getPort();
+   }
+
+   printf("Benchmark: %s, %d s each, %.2f chat lines/s per server, ServerChat latency %d ms\n",
+          relay, seconds, rate, latency);
+   if (faultSpec)
+      printf("Faults: '%s' on %d of %d mock(s), rates and latency between healthy servers only\n", faultSpec, sick, MOCK_SERVERS);
+
+   printf("%6s %7s %12s %12s %10s %10s %8s %10s\n", "N", "faults", "expected/s", "msgs/s", "p50 [ms]", "p99 [ms]", "CPU [%]", "RSS [MB]");
+   fflush(stdout);
+
+   for (const char* p= sizes; p && *p; p= strchr(p, ',') ? strchr(p, ',') + 1 : 0)
+   {
+      int servers= atoi(p);
+
+      if (servers < 2)
+         continue;
+
+      // baseline first, then the same load with faults
+
+      if (bench(servers, mock, ports, no) != success)
+         return 1;
+
+      if (faultSpec && bench(servers, mock, ports, yes) != success)
+         return 1;
+   }
+
+   return 0;
+}
@@ -0,0 +1,92 @@
+//***************************************************************************
+// File breaker.cc
+// Date 18.10.26 - #1
+// Copyright (c) 2017-2026 s710 (s710 (at) posteo (dot) de). All rights reserved.
+// --------------------------------------------------------------------------
+// Ark ClusterChat / reconnect back-off and circuit breaker
+//***************************************************************************
+
+#include <stdlib.h>
+
+#include "breaker.hpp"
+#include "thread.hpp"
+
+//***************************************************************************
+// class CircuitBreaker
+//***************************************************************************
+// ctor
+//***************************************************************************
+
+CircuitBreaker::CircuitBreaker()
+{
+   state= bsClosed;
+   failures= 0;
+   delay= 0;
+   nextAttempt= 0;
+   seed= (unsigned int)(msNow() ^ (unsigned long long)(size_t)this);
+}
+
+//***************************************************************************
+// may attempt
+//***************************************************************************
+
+int CircuitBreaker::mayAttempt()
+{
+   // yes - (re)connect may be tried now
+   // no  - still backing off
+
+   if (msNow() < nextAttempt)
+      return no;
+
+   if (state == bsOpen)
+      state= bsHalfOpen;            // let one probe through
+
+   return yes;
+}
+
+//***************************************************************************
+// success
+//***************************************************************************
+
+int CircuitBreaker::success()
+{
+   // returns yes if the circuit was open before
+
+   int wasOpen= isOpen();
+
+   state= bsClosed;
+   failures= 0;
+   delay= 0;
+   nextAttempt= 0;
+
+   return wasOpen ? yes : no;
+}
+
+//***************************************************************************
+// failure
+//***************************************************************************
+
+int CircuitBreaker::failure()
+{
+   // returns yes if the circuit just opened
+
+   int wasOpen= isOpen();
+
+   failures++;
+
+   // exponential back-off, 'equal jitter': half fixed, half random
+
+   if (!delay)
+      delay= Globals::cfgReconnectMin;
+   else if (delay < Globals::cfgReconnectMax / 2)
+      delay*= 2;
+   else
+      delay= Globals::cfgReconnectMax;
+
+   nextAttempt= msNow() + delay / 2 + (delay > 1 ? rand_r(&seed) % (delay / 2 + 1) : 0);
+
+   if (failures >= Globals::cfgBreakerThreshold)
+      state= bsOpen;
+
+   return !wasOpen && state == bsOpen ? yes : no;
+}
@@ -0,0 +1,57 @@
+//***************************************************************************
+// File breaker.hpp
+// Date 18.10.26 - #1
+// Copyright (c) 2017-2026 s710 (s710 (at) posteo (dot) de). All rights reserved.
+// --------------------------------------------------------------------------
+// Ark ClusterChat / reconnect back-off and circuit breaker
+//***************************************************************************
+
+#ifndef __BREAKER_HPP__
+#define __BREAKER_HPP__
+
+#include "def.h"
+
+//***************************************************************************
+// class CircuitBreaker
+//***************************************************************************
+// one per RCON connection. after a failure the next reconnect is delayed
+// exponentially (with jitter) between cfgReconnectMin and cfgReconnectMax.
+// after cfgBreakerThreshold consecutive failures the circuit opens: no
+// chat is enqueued for the server anymore. once the delay passed, a
+// single probe (reconnect) is allowed (half open). success closes the
+// circuit again, failure re-opens it with the next back-off step.
+//***************************************************************************
+
+class CircuitBreaker
+{
+   public:
+
+      enum BreakerState
+      {
+         bsClosed,
+         bsOpen,
+         bsHalfOpen
+      };
+
+      CircuitBreaker();
+
+      int mayAttempt();
+      int success();
+      int failure();
+
+      int isOpen()        { return state == bsOpen || state == bsHalfOpen; }
+      int isState(BreakerState aState) { return state == aState; }
+      int getFailures()   { return failures; }
+      int getDelay()      { return delay; }
+
+   protected:
+
+      volatile BreakerState state;
+      int failures;                    // consecutive
+      int delay;                       // [ms] current back-off
+      unsigned long long nextAttempt;  // [ms]
+      unsigned int seed;
+};
+
+//***************************************************************************
+#endif // __BREAKER_HPP__
@@ -0,0 +1,268 @@
+//***************************************************************************
+// File capture.cc
+// Date 18.10.26 - #1
+// Copyright (c) 2017-2026 s710 (s710 (at) posteo (dot) de). All rights reserved.
+// --------------------------------------------------------------------------
+// Ark ClusterChat / capture and replay of RCON traffic
+//***************************************************************************
+
+#include <string.h>
+#include <errno.h>
+
+#include "capture.hpp"
+
+Mutex Capture::mutex("Capture");
+FILE* Capture::file= 0;
+unsigned long long Capture::start= 0;
+unsigned long long Capture::records= 0;
+
+std::atomic<int> Replay::exhausted(0);
+std::atomic<unsigned long long> Replay::replayed(0);
+std::atomic<unsigned long long> Replay::sent(0);
+std::atomic<unsigned long long> Replay::lastSent(0);
+std::vector<std::string> Replay::titles;
+std::vector<std::vector<Replay::Entry> > Replay::responses;
+unsigned long long Replay::captured= 0;
+unsigned long long Replay::start= 0;
+double Replay::speed= 1;
+
+//***************************************************************************
+// class Capture
+//***************************************************************************
+// open
+//***************************************************************************
+
+int Capture::open(const char* path, const std::vector<std::string>& titles)
+{
+   if (!(file= fopen(path, "w")))
+   {
+      fprintf(stderr, "Capture: Error: Failed to open '%s' (%s)\n", path, strerror(errno));
+      return fail;
+   }
+
+   start= usNow();
+   fwrite(CAPTURE_MAGIC, 1, sizeof(CAPTURE_MAGIC), file);
+
+   for (size_t i= 0; i < titles.size(); i++)
+      record(i, ckServer, 0, titles[i].c_str(), titles[i].length());
+
+   printf("Capture: Recording RCON traffic to '%s'\n", path);
+
+   return success;
+}
+
+//***************************************************************************
+// record
+//***************************************************************************
+
+void Capture::record(int server, int kind, int flags, const char* data, size_t length)
+{
+   CaptureRecord r;
+
+   r.server= server;
+   r.kind= kind;
+   r.flags= flags;
+   r.length= length;
+
+   mutex.lock();
+
+   if (file)
+   {
+      r.us= usNow() - start;
+
+      fwrite(&r, sizeof(r), 1, file);
+      fwrite(data, 1, length, file);
+      records++;
+   }
+
+   mutex.unlock();
+}
+
+//***************************************************************************
+// close
+//***************************************************************************
+
+void Capture::close()
+{
+   mutex.lock();
+
+   if (file)
+   {
+      fclose(file);
+      file= 0;
+
+      printf("Capture: Wrote %llu record(s)\n", records);
+   }
+
+   mutex.unlock();
+}
+
+//***************************************************************************
+// class Replay
+//***************************************************************************
+// load
+//***************************************************************************
+
+int Replay::load(const char* path, double aSpeed)
+{
+   FILE* f= fopen(path, "r");
+   char magic[sizeof(CAPTURE_MAGIC)];
+   unsigned long long count= 0;
+   CaptureRecord r;
+   std::string data;
+
+   if (!f)
+   {
+      fprintf(stderr, "Replay: Error: Failed to open '%s' (%s)\n", path, strerror(errno));
+      return fail;
+   }
+
+   if (fread(magic, 1, sizeof(magic), f) != sizeof(magic) || memcmp(magic, CAPTURE_MAGIC, sizeof(magic)))
+   {
+      fprintf(stderr, "Replay: Error: '%s' is not a capture file\n", path);
+      fclose(f);
+      return fail;
+   }
+
+   while (fread(&r, sizeof(r), 1, f) == 1)
+   {
+      if (r.length > BUFFSIZE_MAX)
+      {
+         fprintf(stderr, "Replay: Error: Invalid length %u of record %llu in '%s'\n", r.length, count, path);
+         break;
+      }
+
+      data.resize(r.length);
+
+      if (r.length && fread(&data[0], 1, r.length, f) != r.length)
+      {
+         fprintf(stderr, "Replay: Error: Truncated record %llu in '%s'\n", count, path);
+         break;
+      }
+
+      count++;
+
+      if (r.kind == ckServer)
+      {
+         titles.push_back(data);
+         responses.resize(titles.size());
+      }
+      else if (r.kind == ckResponse && r.server < responses.size())
+      {
+         Entry e= { r.us, r.flags, data };
+         responses[r.server].push_back(e);
+      }
+      else if (r.kind == ckCommand)
+         captured++;
+   }
+
+   fclose(f);
+
+   // servers which never had chat are done from the start
+
+   for (size_t i= 0; i < responses.size(); i++)
+      if (responses[i].empty())
+         exhausted++;
+
+   if (titles.size() < 2)
+   {
+      fprintf(stderr, "Replay: Error: '%s' contains less than 2 servers\n", path);
+      return fail;
+   }
+
+   speed= aSpeed;
+   start= usNow();
+
+   if (speed > 0)
+      printf("Replay: Loaded %llu record(s) of %zu server(s) from '%s', speed x%g\n", count, titles.size(), path, speed);
+   else
+      printf("Replay: Loaded %llu record(s) of %zu server(s) from '%s', speed max\n", count, titles.size(), path);
+
+   return success;
+}
+
+//***************************************************************************
+// due in
+//***************************************************************************
+
+long long Replay::dueIn(unsigned long long us)
+{
+   if (speed <= 0)
+      return 0;
+
+   return (long long)(start + (unsigned long long)(us / speed)) - (long long)usNow();
+}
+
+//***************************************************************************
+// report
+//***************************************************************************
+
+void Replay::report()
+{
+   unsigned long long last= lastSent.load();
+   double seconds= last > start ? (last - start) / 1000000.0 : 0;
+
+   printf("Replay: %llu response(s) replayed, %llu command(s) sent (%llu captured) in %.3f s, %.0f command(s)/s\n",
+          replayed.load(), sent.load(), captured, seconds, seconds ? sent.load() / seconds : 0);
+}
+
+//***************************************************************************
+// class ReplayChannel
+//***************************************************************************
+// send command
+//***************************************************************************
+
+int ReplayChannel::sendCommand(const char* command)
+{
+   const std::vector<Replay::Entry>& responses= Replay::responsesOf(server);
+
+   truncated= no;
+
+   if (strncmp(command, "GetChat", 7))
+   {
+      Replay::sent++;
+      Replay::lastSent= usNow();
+
+      return wrnNoResponse;          // like 'Server received, But no response!!'
+   }
+
+   // 'no response' only where the capture has one, an early poll must
+   // not complete a pending tail
+
+   if (next >= responses.size() || Replay::dueIn(responses[next].us) > 0)
+      return wrnNotDue;
+
+   const Replay::Entry& e= responses[next];
+
+   if (e.text.length() && thePacket.resize(e.text.length() + 1) == fail)
+      return fail;
+
+   if (++next == responses.size())
+      Replay::exhausted++;
+
+   if (!e.text.length())
+      return wrnNoResponse;
+
+   memcpy(thePacket.data, e.text.c_str(), e.text.length() + 1);
+   truncated= e.flags & cfTruncated ? yes : no;
+
+   Replay::replayed++;
+
+   return success;
+}
+
+//***************************************************************************
+// next due
+//***************************************************************************
+
+int ReplayChannel::nextDue()
+{
+   const std::vector<Replay::Entry>& responses= Replay::responsesOf(server);
+
+   if (next >= responses.size())
+      return na;
+
+   long long us= Replay::dueIn(responses[next].us);
+
+   return us > 0 ? (int)((us + 999) / 1000) : 0;
+}
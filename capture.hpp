@@ -0,0 +1,139 @@
+//***************************************************************************
+// File capture.hpp
+// Date 18.10.26 - #1
+// Copyright (c) 2017-2026 s710 (s710 (at) posteo (dot) de). All rights reserved.
+// --------------------------------------------------------------------------
+// Ark ClusterChat / capture and replay of RCON traffic
+//***************************************************************************
+
+#ifndef __CAPTURE_HPP__
+#define __CAPTURE_HPP__
+
+#include <stdio.h>
+#include <stdint.h>
+#include <atomic>
+#include <string>
+#include <vector>
+
+#include "channel.hpp"
+#include "thread.hpp"
+
+#define CAPTURE_MAGIC "ARKCAP1"   // 8 bytes with the terminator
+
+//***************************************************************************
+// capture file
+//***************************************************************************
+// magic, then records of a 16 byte header followed by 'length' bytes of
+// data, in host byte order. 'us' counts from opening the capture.
+//***************************************************************************
+
+enum CaptureKind
+{
+   ckServer,         // data: title, in order of the server index
+   ckResponse,       // data: GetChat response (empty if none), flags: cfTruncated
+   ckCommand         // data: command sent (ServerChat, ...)
+};
+
+enum CaptureFlags
+{
+   cfTruncated = 0x01
+};
+
+struct CaptureRecord
+{
+   uint64_t us;
+   uint16_t server;
+   uint8_t kind;
+   uint8_t flags;
+   uint32_t length;
+};
+
+//***************************************************************************
+// class Capture
+//***************************************************************************
+// written by all RConChannels with setCapture(), one lock per record
+//***************************************************************************
+
+class Capture
+{
+   public:
+
+      static int open(const char* path, const std::vector<std::string>& titles);
+      static void record(int server, int kind, int flags, const char* data, size_t length);
+      static void close();
+
+   protected:
+
+      static Mutex mutex;
+      static FILE* file;
+      static unsigned long long start;      // [us]
+      static unsigned long long records;
+};
+
+//***************************************************************************
+// class Replay
+//***************************************************************************
+// a capture loaded into memory, consumed by one ReplayChannel per server.
+// speed 1 replays in real time, N N times faster, 0 as fast as possible
+//***************************************************************************
+
+class Replay
+{
+   public:
+
+      struct Entry
+      {
+         unsigned long long us;
+         int flags;
+         std::string text;
+      };
+
+      static int load(const char* path, double aSpeed);
+      static const std::vector<std::string>& getTitles() { return titles; }
+      static const std::vector<Entry>& responsesOf(int server) { return responses[server]; }
+      static long long dueIn(unsigned long long us);      // [us], <= 0 if due
+      static int finished() { return exhausted.load() >= (int)titles.size(); }
+      static void report();
+
+      static std::atomic<int> exhausted;                    // servers without further responses
+      static std::atomic<unsigned long long> replayed;      // responses
+      static std::atomic<unsigned long long> sent;          // commands
+      static std::atomic<unsigned long long> lastSent;      // [us]
+
+   protected:
+
+      static std::vector<std::string> titles;
+      static std::vector<std::vector<Entry> > responses;  // by server index
+      static unsigned long long captured;                  // commands in the capture
+      static unsigned long long start;                     // [us]
+      static double speed;
+};
+
+//***************************************************************************
+// class ReplayChannel
+//***************************************************************************
+// answers GetChat from the capture instead of a socket, commands are
+// only counted
+//***************************************************************************
+
+class ReplayChannel : public RConChannel
+{
+   public:
+
+      ReplayChannel(int aServer) { server= aServer; next= 0; connected= no; }
+
+      int connect(const char* host, int port, const char* pass) { connected= yes; return success; }
+      int disconnect() { connected= no; return done; }
+      int isConnected() { return connected; }
+      int sendCommand(const char* command);
+      int nextDue();
+
+   protected:
+
+      int server;
+      size_t next;
+      int connected;
+};
+
+//***************************************************************************
+#endif // __CAPTURE_HPP__
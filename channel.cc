@@ -18,8 +18,16 @@
 #include <arpa/inet.h>
 #include <netdb.h>
 #include <errno.h>
+#include <sys/time.h>
+#include <sys/uio.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <vector>
 
 #include "channel.hpp"
+#include "trace.hpp"
+#include "alloc.hpp"
+#include "capture.hpp"
 
 //***************************************************************************
 // class RConChannel
@@ -28,8 +36,13 @@
 //***************************************************************************
 
 RConChannel::RConChannel()
+   : sockMutex("Channel")
 {
    rsock= na;
+   timeout= 0;
+   truncated= no;
+   metrics= 0;
+   captureId= na;
 }
 
 RConChannel::~RConChannel()
@@ -44,50 +57,39 @@ RConChannel::~RConChannel()
 int RConChannel::connect(const char* host, int port, const char* pass)
 {
    int res= success;
-   char tmp[30];
-   struct addrinfo* serverinfo;
-   struct addrinfo hints;
+   int sock;
+   AddressList addresses;
 
-   sprintf(tmp, "%d", port);
+   // (1) resolve (cached) and open socket
 
-   // (1) open socket
-
-   memset(&hints, 0, sizeof(hints));
-   hints.ai_family   = AF_UNSPEC;
-   hints.ai_socktype = SOCK_STREAM;
-   hints.ai_protocol = IPPROTO_TCP;
-
-   res = getaddrinfo(host, tmp, &hints, &serverinfo);
-
-   if (res)
-   {
-      fprintf(stderr, "Error: Failed to resolve host '%s' (%d / %s)\n",
-            host ? host : "", errno, strerror(errno));
+   if (Resolver::lookup(host, port, &addresses) != success)
       return fail;
-   }
 
-   rsock= socket(serverinfo->ai_family, serverinfo->ai_socktype, serverinfo->ai_protocol);
+   sock= connectAny(addresses);
 
-   if (rsock < 0)
+   sockMutex.lock();
+   rsock= sock;
+   sockMutex.unlock();
+
+   if (rsock == na)
    {
-      fprintf(stderr, "Error: Failed to create socket to host '%s' (%d / %s)\n",
+      fprintf(stderr, "Error: Failed to connect to host '%s' (%d / %s)\n",
             host ? host : "", errno, strerror(errno));
 
-      freeaddrinfo(serverinfo);
       return fail;
    }
 
-   if (::connect(rsock, serverinfo->ai_addr, serverinfo->ai_addrlen) != 0)
+   if (timeout > 0)
    {
-      fprintf(stderr, "Error: Failed to connect to host '%s' (%d / %s)\n",
-            host ? host : "", errno, strerror(errno));
+      // never block forever in send/recv, e.g. when host stalls
 
-      disconnect();
-      freeaddrinfo(serverinfo);
-      return fail;
-   }
+      timeval tv;
+      tv.tv_sec= timeout;
+      tv.tv_usec= 0;
 
-   freeaddrinfo(serverinfo);
+      setsockopt(rsock, SOL_SOCKET, SO_RCVTIMEO, &tv, sizeof(tv));
+      setsockopt(rsock, SOL_SOCKET, SO_SNDTIMEO, &tv, sizeof(tv));
+   }
 
    // (2) authentication
 
@@ -97,26 +99,168 @@ int RConChannel::connect(const char* host, int port, const char* pass)
    return res;
 }
 
+//***************************************************************************
+// connect any
+//***************************************************************************
+
+int RConChannel::connectAny(const AddressList& addresses)
+{
+   // happy eyeballs (RFC 8305): addresses come interleaved by family.
+   // start the next attempt every CONNECT_STAGGER ms (or as soon as one
+   // failed) while earlier ones are still pending, first to connect wins.
+
+   std::vector<pollfd> fds;
+   size_t next= 0;
+   int winner= na;
+   int lastError= ECONNREFUSED;
+   unsigned long long deadline= msNow() + (timeout > 0 ? timeout : 60) * 1000;
+   unsigned long long nextStart= 0;
+
+   while (winner == na)
+   {
+      unsigned long long now= msNow();
+
+      if (now >= deadline)
+      {
+         lastError= ETIMEDOUT;
+         break;
+      }
+
+      if (next < addresses.size() && now >= nextStart)
+      {
+         const Address& a= addresses[next++];
+         int sock= socket(a.family, SOCK_STREAM, IPPROTO_TCP);
+
+         nextStart= now + CONNECT_STAGGER;
+
+         if (sock < 0)
+         {
+            lastError= errno;       // e.g. EAFNOSUPPORT without IPv6
+            nextStart= now;
+            continue;
+         }
+
+         fcntl(sock, F_SETFL, fcntl(sock, F_GETFL, 0) | O_NONBLOCK);
+
+         if (::connect(sock, (sockaddr*)&a.addr, a.len) == 0)
+         {
+            winner= sock;
+            break;
+         }
+
+         if (errno != EINPROGRESS)
+         {
+            lastError= errno;
+            ::close(sock);
+            nextStart= now;
+            continue;
+         }
+
+         pollfd p;
+         p.fd= sock;
+         p.events= POLLOUT;
+         p.revents= 0;
+         fds.push_back(p);
+      }
+
+      if (fds.empty())
+      {
+         if (next >= addresses.size())
+            break;
+
+         continue;
+      }
+
+      unsigned long long until= next < addresses.size() && nextStart < deadline ? nextStart : deadline;
+
+      if (::poll(&fds[0], fds.size(), until > now ? (int)(until - now) : 0) <= 0)
+         continue;
+
+      for (size_t i= 0; i < fds.size(); i++)
+      {
+         int err= 0;
+         socklen_t len= sizeof(err);
+
+         if (!fds[i].revents)
+            continue;
+
+         getsockopt(fds[i].fd, SOL_SOCKET, SO_ERROR, &err, &len);
+
+         if (!err && winner == na)
+         {
+            winner= fds[i].fd;
+            continue;
+         }
+
+         lastError= err ? err : lastError;
+         ::close(fds[i].fd);
+         fds.erase(fds.begin() + i--);
+         nextStart= msNow();
+      }
+   }
+
+   // close the losers
+
+   for (size_t i= 0; i < fds.size(); i++)
+      if (fds[i].fd != winner)
+         ::close(fds[i].fd);
+
+   if (winner == na)
+   {
+      errno= lastError;
+      return na;
+   }
+
+   fcntl(winner, F_SETFL, fcntl(winner, F_GETFL, 0) & ~O_NONBLOCK);
+
+   return winner;
+}
+
 //***************************************************************************
 // disconnect
 //***************************************************************************
 
 int RConChannel::disconnect()
 {
+   sockMutex.lock();
+
    if (rsock != na)
       ::close(rsock);
 
    rsock= na;
 
+   sockMutex.unlock();
+
    return done;
 }
 
+//***************************************************************************
+// abort
+//***************************************************************************
+
+void RConChannel::abort()
+{
+   // may be called from another thread, wakes up a blocking send/recv.
+   // socket is closed later on by the owning thread in disconnect(),
+   // the lock keeps it from being closed (and the fd reused) meanwhile
+
+   sockMutex.lock();
+
+   if (rsock != na)
+      ::shutdown(rsock, SHUT_RDWR);
+
+   sockMutex.unlock();
+}
+
 //***************************************************************************
 // send
 //***************************************************************************
 
 int RConChannel::send(int id, int cmd, const char* commandString)
 {
+   TRACE_SPAN("send");
+   ALLOC_SCOPE(atChannel);
+
    int res= 0;
    int commandLen= strlen(commandString);
 
@@ -135,16 +279,37 @@ int RConChannel::send(int id, int cmd, const char* commandString)
 
    sprintf(thePacket.data, "%.*s", commandLen, commandString);
 
-   if ((res= _send((char*)&thePacket.size, sizeof(int))) != success)
-      return fail;
-   
-   if ((res= _send((char*)&thePacket.id, sizeof(int))) != success)
+   // header and body in one go, separate small writes are delayed by
+   // nagle/delayed ack for ~40ms per packet
+
+   int header[3]= { thePacket.size, thePacket.id, thePacket.cmd };
+   int dataLen= thePacket.size - 2*sizeof(int);
+   iovec iov[2];
+
+   iov[0].iov_base= header;
+   iov[0].iov_len= sizeof(header);
+   iov[1].iov_base= thePacket.data;
+   iov[1].iov_len= dataLen;
+
+   res= ::writev(rsock, iov, 2);
+
+   if (res < 0)
+   {
+      fprintf(stderr, "Error: Failed to send bytes (%d / %s)\n", errno, strerror(errno));
       return fail;
-   
-   if ((res= _send((char*)&thePacket.cmd, sizeof(int))) != success)
+   }
+
+   if (metrics)
+      metrics->bytesOut.add(res);
+
+   // partially sent, continue with the remainder
+
+   if (res < (int)sizeof(header) && _send((char*)header + res, sizeof(header) - res) != success)
       return fail;
 
-   if ((res= _send(thePacket.data, thePacket.size - 2*sizeof(int))) != success)
+   res= res < (int)sizeof(header) ? 0 : res - sizeof(header);
+
+   if (res < dataLen && _send(thePacket.data + res, dataLen - res) != success)
       return fail;
 
    return success;
@@ -172,6 +337,9 @@ int RConChannel::_send(char* buffer, int len)
       bytesSent+= res;
    }
 
+   if (metrics)
+      metrics->bytesOut.add(bytesSent);
+
    return bytesSent == len ? success : fail;
 
 }
@@ -182,6 +350,9 @@ int RConChannel::_send(char* buffer, int len)
 
 int RConChannel::receive()
 {
+   TRACE_SPAN("receive");
+   ALLOC_SCOPE(atChannel);
+
    int res= success;
 
    thePacket.clear();
@@ -189,16 +360,18 @@ int RConChannel::receive()
    if ((res= _receive((char*)&thePacket.size, thePacket.getSize(), sizeof(int))) != success)
       return res;
 
-   if (thePacket.resize(thePacket.size) != success)
+   // a bogus size means the frame boundary is lost, the connection
+   // can't be used any more. the caller reconnects
+
+   if (thePacket.size < 10 || thePacket.size > BUFFSIZE_MAX)
    {
-      fprintf(stderr, "Error: Failed to resize buffer to (%d), can't receive packet!\n", thePacket.size);
-      flushLine();
+      fprintf(stderr, "Error: Invalid packet size (%d), must be 10..%d\n", thePacket.size, BUFFSIZE_MAX);
+      return fail;
    }
 
-   if (thePacket.size < 10) 
+   if (thePacket.resize(thePacket.size) != success)
    {
-      fprintf(stderr, "Error: invalid packet size (%d). Must over 10.\n", thePacket.size);
-      flushLine();
+      fprintf(stderr, "Error: Failed to resize buffer to (%d), can't receive packet!\n", thePacket.size);
       return fail;
    }
 
@@ -211,6 +384,51 @@ int RConChannel::receive()
    if ((res= _receive(thePacket.data, thePacket.getSize(), thePacket.size - 2*sizeof(int))) != success)
       return res;
 
+   // body should end in two null bytes, don't rely on it
+
+   thePacket.data[thePacket.size - 2*sizeof(int)]= 0;
+
+   return success;
+}
+
+//***************************************************************************
+// receive rest
+//***************************************************************************
+
+int RConChannel::receiveRest(int* lastLen)
+{
+   // the server answers commands in order, the mirror of an empty
+   // RC_RESPONSE packet sent now follows the last packet of the response
+
+   std::string body(thePacket.data);
+   int res;
+
+   if ((res= send(RC_SENTINEL, RC_RESPONSE, "")))
+      return res;
+
+   for (;;)
+   {
+      if ((res= receive()))
+         return res;
+
+      if (thePacket.id == RC_SENTINEL)
+         break;
+
+      if (thePacket.id != RC_PID)
+         return errWrongSequence;
+
+      *lastLen= strlen(thePacket.data);
+      body.append(thePacket.data, *lastLen);
+   }
+
+   if (thePacket.resize(body.size() + 1) != success)
+   {
+      fprintf(stderr, "Error: Failed to resize buffer to (%zu), response dropped!\n", body.size() + 1);
+      return fail;
+   }
+
+   memcpy(thePacket.data, body.c_str(), body.size() + 1);
+
    return success;
 }
 
@@ -233,20 +451,16 @@ int RConChannel::_receive(char* buffer, int bufSize, int len)
          return fail;
       }
 
+      if (!res)
+         break;         // connection closed by peer
+
       bytesRead+= res;
    }
 
-   return len == na ? success : (bytesRead == len ? success : fail);
-}
+   if (metrics)
+      metrics->bytesIn.add(bytesRead);
 
-//***************************************************************************
-// flushLine
-//***************************************************************************
-
-int RConChannel::flushLine()
-{
-   _receive(thePacket.data, thePacket.getSize());
-   return done;
+   return len == na ? success : (bytesRead == len ? success : fail);
 }
 
 //***************************************************************************
@@ -274,33 +488,77 @@ int RConChannel::sendCommand(const char* command)
 {
    int res= success;
 
+   int getChat= !strncmp(command, "GetChat", 7);
+
+   truncated= no;
+
+   if (captureId != na && !getChat)
+      Capture::record(captureId, ckCommand, 0, command, strlen(command));
+
    res= send(RC_PID, RC_COMMAND, command);
 
    if (res)
       return res;
 
-   if ((res= receive()))
-      return res;
+   // skip a late reply to the sentinel of the previous response,
+   // Source servers send an extra packet after the mirrored one
+
+   do
+   {
+      if ((res= receive()))
+         return res;
+
+   } while (thePacket.id == RC_SENTINEL);
 
    if (thePacket.id != RC_PID)
       return errWrongSequence;
 
-   // got response?
+   // got response? an empty one is captured as well, it completes a
+   // pending tail on replay like it does here
 
    if (thePacket.size <= 10)
+   {
+      if (captureId != na && getChat)
+         Capture::record(captureId, ckResponse, 0, "", 0);
+
       return wrnNoResponse;
+   }
 
-   // clear trailing spaces and linefeed
+   // a full packet may be followed by more packets of the same response,
+   // all are read now instead of being left for the next command. if the
+   // last one is still full and not ending in a line feed, the server cut
+   // the response and the rest comes with the next one
 
-   char* t= thePacket.data + strlen(thePacket.data);
+   int len= strlen(thePacket.data);
+   int lastLen= len;
 
-   while (!*t && (t-thePacket.data))
-      t--;
+   if (len >= RCON_PACKET_MAX && (res= receiveRest(&lastLen)) != success)
+      return res;
+
+   len= strlen(thePacket.data);
+   truncated= lastLen >= RCON_PACKET_MAX && thePacket.data[len-1] != '\n';
 
-   while ((*t == ' ' || *t == '\n' || *t == '\r') && (t-thePacket.data))
-      *t--= 0;
+   // clear trailing spaces and linefeed of a complete response (the
+   // 'no response' marker ends in " \n"). a cut one keeps its bytes, a
+   // space at the cut separates the last word from the next packet's
+
+   if (!truncated)
+   {
+      char* t= thePacket.data + len;
 
-   if (!strcmp(thePacket.data, "Server received, But no response!!"))
+      while (!*t && (t-thePacket.data))
+         t--;
+
+      while ((*t == ' ' || *t == '\n' || *t == '\r') && (t-thePacket.data))
+         *t--= 0;
+   }
+
+   int empty= !strcmp(thePacket.data, "Server received, But no response!!");
+
+   if (captureId != na && getChat)
+      Capture::record(captureId, ckResponse, truncated ? cfTruncated : 0, empty ? "" : thePacket.data, empty ? 0 : strlen(thePacket.data));
+
+   if (empty)
       return wrnNoResponse;
 
    return success;
@@ -338,7 +596,12 @@ int RConPacket::resize(int newSize)
    if (packetSize >= newSize)
       return done;
 
-   data= (char*)realloc(data, newSize * sizeof(char));
+   char* newData= (char*)realloc(data, newSize * sizeof(char));
+
+   if (!newData)
+      return fail;
+
+   data= newData;
    packetSize= newSize;
 
    return done;
@@ -10,13 +10,19 @@
 #define __CHANNEL_HPP__
 
 #include "def.h"
+#include "resolver.hpp"
+#include "metrics.hpp"
 
 #define RC_PID      42
+#define RC_SENTINEL 43        // id of the empty packet marking the end of a split response
+#define RC_RESPONSE 0
 #define RC_COMMAND  2
 #define RC_AUTH_RESPONSE 2
 #define RC_AUTHENTICATE  3
 #define BUFFSIZE_DEF 10240
 #define BUFFSIZE_MAX 1024*1024*10
+#define CONNECT_STAGGER 250   // [ms] delay between connection attempts (happy eyeballs)
+#define RCON_PACKET_MAX 4096  // body of a single response packet, longer ones are split
 
 //***************************************************************************
 // struct RConPacket
@@ -54,17 +60,30 @@ class RConChannel
    public:
 
       RConChannel();
-      ~RConChannel();
+      virtual ~RConChannel();
 
-      int connect(const char* host, int port, const char* pass);
-      int disconnect();
+      virtual int connect(const char* host, int port, const char* pass);
+      virtual int disconnect();
+      void abort();
 
-      int sendCommand(const char* command);
+      void setTimeout(int seconds) { timeout= seconds; }
+      void setMetrics(ServerMetrics* aMetrics) { metrics= aMetrics; }
+      void setCapture(int server) { captureId= server; }
+      virtual int isConnected() { return rsock != na; }
+      int isTruncated() { return truncated; }
+
+      virtual int sendCommand(const char* command);
+      virtual int nextDue() { return na; }     // [ms] until the next response is available, na - unknown
       char* getBuffer() { return thePacket.getBuffer(); }
 
    protected:
 
-      int rsock; /* rcon socket */
+      int rsock; /* rcon socket, changed by the owning thread under sockMutex */
+      Mutex sockMutex; /* abort() of another thread must not hit a closed, reused fd */
+      int timeout; /* send/receive timeout [s] */
+      int truncated; /* last response filled a whole packet, no line end */
+      ServerMetrics* metrics; /* bytes in/out, optional */
+      int captureId; /* server index in the capture (--capture), na - off */
 
       RConPacket thePacket;
 
@@ -72,12 +91,13 @@ class RConChannel
 
       // tcp/protocol functions
 
+      int connectAny(const AddressList& addresses);
       int send(int id, int cmd, const char* commandString);
       int _send(char* buffer, int len);
       int receive();
+      int receiveRest(int* lastLen);
       int _receive(char* buffer, int bufSize, int len= na);
       int authenticate(const char *passwd);
-      int flushLine();
 };
 
 
@@ -0,0 +1,90 @@
+//***************************************************************************
+// File chatline.cc
+// Date 18.10.26 - #1
+// Copyright (c) 2017-2026 s710 (s710 (at) posteo (dot) de). All rights reserved.
+// --------------------------------------------------------------------------
+// Ark ClusterChat / structured chat line
+//***************************************************************************
+
+#include "chatline.hpp"
+#include "def.h"
+
+//***************************************************************************
+// set span
+//***************************************************************************
+
+static inline void setSpan(ChatSpan* span, size_t from, size_t to)
+{
+   span->offset= (int)from;
+   span->length= to > from ? (int)(to - from) : 0;
+}
+
+//***************************************************************************
+// parse
+//***************************************************************************
+
+int ChatLine::parse(const char* line, int len, int aKind)
+{
+   // success - sender found
+   // fail    - unstructured, body is the whole line
+
+   std::string_view s(line, len);
+   size_t start= 0, colon, paren;
+
+   kind= aKind;
+   setSpan(&channel, 0, 0);
+   setSpan(&steamName, 0, 0);
+   setSpan(&characterName, 0, 0);
+   setSpan(&body, 0, len);
+
+   // optional leading "[Channel] "
+
+   if (len && line[0] == '[')
+   {
+      size_t close= s.find(']');
+
+      if (close != std::string_view::npos && close < 32)
+      {
+         setSpan(&channel, 1, close);
+         start= close + 1;
+
+         while (start < s.size() && s[start] == ' ')
+            start++;
+      }
+   }
+
+   // "SteamName (CharacterName): body", names may contain ':' or '(',
+   // so anchor at the first "): " and take the last " (" before it
+
+   colon= s.find("): ", start);
+
+   if (colon != std::string_view::npos)
+   {
+      paren= s.rfind(" (", colon);
+
+      if (paren != std::string_view::npos && paren > start)
+      {
+         setSpan(&steamName, start, paren);
+         setSpan(&characterName, paren + 2, colon);
+         setSpan(&body, colon + 3, len);
+
+         return success;
+      }
+   }
+
+   // "Sender: body" (SERVER, AdminCmd, players without character)
+
+   colon= s.find(": ", start);
+
+   if (colon != std::string_view::npos && colon > start)
+   {
+      setSpan(&steamName, start, colon);
+      setSpan(&body, colon + 2, len);
+
+      return success;
+   }
+
+   setSpan(&body, start, len);
+
+   return fail;
+}
@@ -0,0 +1,55 @@
+//***************************************************************************
+// File chatline.hpp
+// Date 18.10.26 - #1
+// Copyright (c) 2017-2026 s710 (s710 (at) posteo (dot) de). All rights reserved.
+// --------------------------------------------------------------------------
+// Ark ClusterChat / structured chat line
+//***************************************************************************
+
+#ifndef __CHATLINE_HPP__
+#define __CHATLINE_HPP__
+
+#include <string>
+#include <string_view>
+
+#include "linescan.hpp"
+
+//***************************************************************************
+// struct ChatSpan
+//***************************************************************************
+// offset/length relative to the start of the line, so a record stays valid
+// for any copy of the line (receive buffer, Work::message, ...)
+//***************************************************************************
+
+struct ChatSpan
+{
+   int offset;
+   int length;
+
+   std::string_view view(const char* line) const { return std::string_view(line + offset, length); }
+   std::string_view view(const std::string& line) const { return view(line.c_str()); }
+   int isEmpty() const { return length == 0; }
+};
+
+//***************************************************************************
+// struct ChatLine
+//***************************************************************************
+// "[Channel] SteamName (CharacterName): body"
+//   channel and character name are optional, lines not matching the
+//   pattern at all have only a body (the whole line)
+//***************************************************************************
+
+struct ChatLine
+{
+   int kind;                  // LineKind
+   ChatSpan channel;
+   ChatSpan steamName;
+   ChatSpan characterName;
+   ChatSpan body;
+
+   int parse(const char* line, int len, int aKind= lkChat);
+   int isStructured() const { return !steamName.isEmpty(); }
+};
+
+//***************************************************************************
+#endif // __CHATLINE_HPP__
@@ -9,6 +9,9 @@
 #include <stdio.h>
 
 #include "clusterchat.hpp"
+#include "rules.hpp"
+#include "alloc.hpp"
+#include "capture.hpp"
 
 //***************************************************************************
 // class ClusterChat
@@ -18,10 +21,15 @@
 
 ClusterChat::ClusterChat()
 {
+   metrics= 0;
+   watchdog= 0;
 }
 
 ClusterChat::~ClusterChat()
 {
+   delete metrics;
+   delete watchdog;
+
    for (std::list<RConThread*>::iterator it= threads.begin(); it != threads.end(); ++it)
       delete *it;
 }
@@ -33,12 +41,64 @@ ClusterChat::~ClusterChat()
 int ClusterChat::init(std::list<ServerConfig*>* configs)
 {
    int res= success;
+   std::vector<std::string> titles;
+
+   if (configs->size() > MAX_SERVERS)
+   {
+      fprintf(stderr, "ClusterChat: Error: At most %d servers are supported\n", MAX_SERVERS);
+      return fail;
+   }
+
+   // rules refer to servers by title
+
+   for (std::list<ServerConfig*>::iterator it= configs->begin(); it != configs->end(); ++it)
+      titles.push_back((*it)->title);
+
+   RuleSet::setServers(titles);
+
+   if (Globals::cfgCaptureFile && Capture::open(Globals::cfgCaptureFile, titles) != success)
+      return fail;
+
+   if (RuleSet::reload() != success)
+      return fail;
 
    for (std::list<ServerConfig*>::iterator it= configs->begin(); it != configs->end(); ++it)
    {
       RConThread* thread = new RConThread(&threads);
       ServerConfig* cfg= *it;
 
+      thread->setIndex(threads.size());
+      thread->setServerCount(configs->size());
+
+      // servers with equal templates share one compiled format
+
+      const MessageFormat* format= MessageFormat::get(cfg->format.empty() ? Globals::cfgFormat : cfg->format.c_str());
+
+      if (!format)
+      {
+         delete thread;
+         shutdown();
+
+         return fail;
+      }
+
+      thread->setFormat(format);
+
+      if (!cfg->warmup.empty())
+      {
+         int policy, value;
+
+         if (RConThread::parseWarmup(cfg->warmup.c_str(), &policy, &value) != success)
+         {
+            delete thread;
+            shutdown();
+
+            return fail;
+         }
+
+         thread->setWarmup(policy, value);
+      }
+
       res= thread->start(120, cfg->host.c_str(), cfg->port, cfg->password.c_str(), cfg->title.c_str());
 
       if (res)
@@ -54,6 +114,28 @@ int ClusterChat::init(std::list<ServerConfig*>* configs)
 
    }
 
+   if (Globals::cfgWatchdog)
+   {
+      watchdog= new Watchdog(&threads);
+
+      if ((res= watchdog->open(Globals::cfgWatchdog)) != success)
+      {
+         shutdown();
+         return res;
+      }
+   }
+
+   if (Globals::cfgMetricsPort)
+   {
+      metrics= new MetricsServer;
+
+      if ((res= metrics->open(Globals::cfgMetricsPort)) != success)
+      {
+         shutdown();
+         return res;
+      }
+   }
+
    return res;
 }
 
@@ -63,10 +145,68 @@ int ClusterChat::init(std::list<ServerConfig*>* configs)
 
 int ClusterChat::shutdown()
 {
+   int delivered= 0, dropped= 0;
+   unsigned long long sent= 0;
+   int timeoutMs= Globals::cfgDrainTimeout * 1000;
+   unsigned long long start= msNow();
+   unsigned long long deadline= start + timeoutMs;
+   std::list<RConThread*>::iterator it;
+
+   if (metrics)
+      metrics->stop();
+
+   // a draining thread must not be reset
+
+   if (watchdog)
+      watchdog->stop();
+
    printf("ClusterChat: Stopping worker threads ...\n");
 
-   for (std::list<RConThread*>::iterator it= threads.begin(); it != threads.end(); ++it)
-      (*it)->stop();
+   // (1) signal all threads at once, each drains its own queue in parallel
+
+   for (it= threads.begin(); it != threads.end(); ++it)
+      (*it)->requestStop(timeoutMs);
+
+   // (2) wait for drain, allow one extra I/O timeout for a pending command
+
+   deadline+= Globals::cfgRconTimeout * 1000;
+
+   for (it= threads.begin(); it != threads.end(); ++it)
+   {
+      unsigned long long now= msNow();
+
+      if ((*it)->waitForStopped(now < deadline ? (int)(deadline - now) : 0) != yes)
+         (*it)->abort();
+   }
+
+   // (3) join and collect statistics
+
+   for (it= threads.begin(); it != threads.end(); ++it)
+   {
+      (*it)->finish();
+
+      delivered+= (*it)->getDelivered();
+      dropped+= (*it)->getDropped();
+      sent+= (*it)->getSent();
+   }
+
+   printf("ClusterChat: Stopped after %llu ms, %d pending message(s) delivered, %d dropped\n",
+         msNow() - start, delivered, dropped);
+
+   if (Globals::cfgCaptureFile)
+      Capture::close();
+
+   if (Globals::cfgReplayFile)
+      Replay::report();
+
+   if (RuleSet::current())
+      RuleSet::current()->report();
+
+   if (Globals::cfgLatencyMatrix)
+      MetricsServer::writeMatrix(Globals::cfgLatencyMatrix);
+
+   if (AllocStats::check(sent) != success)
+      return fail;
 
    return done;
 }
@@ -12,6 +12,8 @@
 #include <list>                   // std::list
 #include <string>                 // std::string
 #include "rconthread.hpp"
+#include "metrics.hpp"
+#include "watchdog.hpp"
 
 //***************************************************************************
 // struct ServerConfig
@@ -22,6 +24,8 @@ struct ServerConfig
    std::string host;
    std::string password;
    std::string title;
+   std::string format;      // empty - Globals::cfgFormat
+   std::string warmup;      // empty - Globals::cfgWarmup
    int port;
 };
 
@@ -42,6 +46,8 @@ class ClusterChat
    protected:
 
       std::list<RConThread*> threads;
+      MetricsServer* metrics;
+      Watchdog* watchdog;
 };
 
 //***************************************************************************
@@ -0,0 +1,45 @@
+//***************************************************************************
+// File def.cc
+// Date 18.10.26 - #1
+// Copyright (c) 2017-2026 s710 (s710 (at) posteo (dot) de). All rights reserved.
+// --------------------------------------------------------------------------
+// Ark ClusterChat / globals
+//***************************************************************************
+
+#include "def.h"
+#include "format.hpp"
+
+//***************************************************************************
+// global flags (defaults, set from command line in main.cc)
+//***************************************************************************
+
+int Globals::cfgVerbose= 0;
+int Globals::cfgDebug= 0;
+int Globals::cfgShowAdmin= 0;
+int Globals::cfgDrainTimeout= 5;
+int Globals::cfgRconTimeout= 10;
+int Globals::cfgSplitChannels= 0;
+int Globals::cfgReconnectMin= 1000;
+int Globals::cfgReconnectMax= 60000;
+int Globals::cfgBreakerThreshold= 3;
+int Globals::cfgDnsTtl= 300;
+const char* Globals::cfgFilterFile= 0;
+int Globals::cfgFilterAction= 0;
+const char* Globals::cfgRulesFile= 0;
+int Globals::cfgMaxMessageLength= 0;
+const char* Globals::cfgFormat= DEFAULT_FORMAT;
+int Globals::cfgWarmup= 0;
+int Globals::cfgWarmupValue= 0;
+int Globals::cfgFloodRate= 0;
+int Globals::cfgFloodBurst= 5;
+int Globals::cfgCollapseRepeats= 0;
+int Globals::cfgReorderWindow= 0;
+int Globals::cfgMetricsPort= 0;
+const char* Globals::cfgTraceFile= 0;
+const char* Globals::cfgLatencyMatrix= 0;
+int Globals::cfgAllocReport= 0;
+double Globals::cfgAllocLimit= -1;
+const char* Globals::cfgCaptureFile= 0;
+const char* Globals::cfgReplayFile= 0;
+double Globals::cfgReplaySpeed= 1;
+int Globals::cfgWatchdog= 60;
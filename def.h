@@ -37,7 +37,8 @@ enum Errors
    errFirst= -99,
 
    errWrongSequence,
-   wrnNoResponse
+   wrnNoResponse,
+   wrnNotDue          // replay, no response recorded for this time yet
 };
 
 // global flags
@@ -49,6 +50,33 @@ class Globals
       static int cfgVerbose;
       static int cfgDebug;
       static int cfgShowAdmin;
+      static int cfgDrainTimeout;    // [s]
+      static int cfgRconTimeout;     // [s]
+      static int cfgSplitChannels;
+      static int cfgReconnectMin;    // [ms]
+      static int cfgReconnectMax;    // [ms]
+      static int cfgBreakerThreshold;
+      static int cfgDnsTtl;          // [s]
+      static const char* cfgFilterFile;
+      static int cfgFilterAction;    // KeywordFilter::Action
+      static const char* cfgRulesFile;
+      static int cfgMaxMessageLength;
+      static const char* cfgFormat;
+      static int cfgWarmup;          // WarmupPolicy
+      static int cfgWarmupValue;
+      static int cfgFloodRate;       // [messages/min]
+      static int cfgFloodBurst;
+      static int cfgCollapseRepeats; // [s]
+      static int cfgReorderWindow;   // [ms]
+      static int cfgMetricsPort;
+      static const char* cfgTraceFile;
+      static const char* cfgLatencyMatrix;
+      static int cfgAllocReport;     // [s]
+      static double cfgAllocLimit;   // per message, < 0 off
+      static const char* cfgCaptureFile;
+      static const char* cfgReplayFile;
+      static double cfgReplaySpeed;  // 0 - max
+      static int cfgWatchdog;        // [s], 0 off
 };
 
 
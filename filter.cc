@@ -0,0 +1,302 @@
+//***************************************************************************
+// File filter.cc
+// Date 18.10.26 - #1
+// Copyright (c) 2017-2026 s710 (s710 (at) posteo (dot) de). All rights reserved.
+// --------------------------------------------------------------------------
+// Ark ClusterChat / keyword filter (Aho-Corasick)
+//***************************************************************************
+
+#include <stdio.h>
+#include <string.h>
+#include <ctype.h>
+#include <errno.h>
+
+#include "filter.hpp"
+
+//***************************************************************************
+// class KeywordFilter
+//***************************************************************************
+
+Mutex KeywordFilter::activeMutex("KeywordFilter");
+std::shared_ptr<const KeywordFilter> KeywordFilter::active;
+
+//***************************************************************************
+// ctor
+//***************************************************************************
+
+KeywordFilter::KeywordFilter()
+{
+   memset(classOf, 0, sizeof(classOf));
+   classes= 1;
+}
+
+//***************************************************************************
+// add
+//***************************************************************************
+
+int KeywordFilter::add(const char* pattern, int len)
+{
+   // trim, patterns are matched case insensitive
+
+   while (len && isspace((unsigned char)*pattern))
+      pattern++, len--;
+
+   while (len && isspace((unsigned char)pattern[len-1]))
+      len--;
+
+   if (!len)
+      return fail;
+
+   std::string p(pattern, len);
+
+   for (size_t i= 0; i < p.size(); i++)
+      p[i]= tolower((unsigned char)p[i]);
+
+   patterns.push_back(p);
+
+   return success;
+}
+
+//***************************************************************************
+// load
+//***************************************************************************
+
+int KeywordFilter::load(const char* path)
+{
+   // one pattern per line, '#' starts a comment line
+
+   char line[1024];
+   int lineNo= 0;
+   FILE* f= fopen(path, "r");
+
+   if (!f)
+   {
+      fprintf(stderr, "Error: Failed to open filter file '%s' (%s)\n", path, strerror(errno));
+      return fail;
+   }
+
+   while (fgets(line, sizeof(line), f))
+   {
+      lineNo++;
+
+      // don't split a long line into two patterns
+
+      if (!strchr(line, '\n') && !feof(f))
+      {
+         fprintf(stderr, "Error: Filter line %d: longer than %zu characters\n", lineNo, sizeof(line) - 2);
+         fclose(f);
+         return fail;
+      }
+
+      if (line[0] == '#')
+         continue;
+
+      add(line, strlen(line));
+   }
+
+   fclose(f);
+
+   return build();
+}
+
+//***************************************************************************
+// build
+//***************************************************************************
+
+int KeywordFilter::build()
+{
+   std::vector<int> failure, length, queue;
+
+   // input classes, 0 is 'any byte not in a pattern'
+
+   memset(classOf, 0, sizeof(classOf));
+   classes= 1;
+
+   for (size_t i= 0; i < patterns.size(); i++)
+   {
+      for (size_t c= 0; c < patterns[i].size(); c++)
+      {
+         unsigned char ch= patterns[i][c];
+
+         if (!classOf[ch])
+         {
+            classOf[ch]= classes;
+            classOf[toupper(ch)]= classes;
+            classes++;
+         }
+      }
+   }
+
+   // trie
+
+   next.assign(classes, -1);
+   length.assign(1, 0);
+
+   for (size_t i= 0; i < patterns.size(); i++)
+   {
+      int state= 0;
+
+      for (size_t c= 0; c < patterns[i].size(); c++)
+      {
+         int cls= classOf[(unsigned char)patterns[i][c]];
+
+         if (next[state * classes + cls] < 0)
+         {
+            next[state * classes + cls]= length.size();
+            next.resize(next.size() + classes, -1);
+            length.push_back(0);
+         }
+
+         state= next[state * classes + cls];
+      }
+
+      length[state]= patterns[i].size();
+   }
+
+   // failure links, breadth first, turned into a full transition table
+
+   failure.assign(length.size(), 0);
+   output.assign(length.size(), 0);
+
+   for (int cls= 0; cls < classes; cls++)
+   {
+      int& child= next[cls];
+
+      if (child < 0)
+         child= 0;
+      else
+         queue.push_back(child);
+   }
+
+   for (size_t q= 0; q < queue.size(); q++)
+   {
+      int state= queue[q];
+
+      // a pattern of our own is always longer than one of our suffix
+
+      output[state]= length[state] ? length[state] : output[failure[state]];
+
+      for (int cls= 0; cls < classes; cls++)
+      {
+         int& child= next[state * classes + cls];
+         int fallback= next[failure[state] * classes + cls];
+
+         if (child < 0)
+            child= fallback;
+         else
+         {
+            failure[child]= fallback;
+            queue.push_back(child);
+         }
+      }
+   }
+
+   return success;
+}
+
+//***************************************************************************
+// match
+//***************************************************************************
+
+int KeywordFilter::match(const char* text, int len) const
+{
+   const unsigned char* p= (const unsigned char*)text;
+   int state= 0;
+
+   if (patterns.empty())
+      return no;
+
+   for (int i= 0; i < len; i++)
+   {
+      state= next[state * classes + classOf[p[i]]];
+
+      if (output[state])
+         return yes;
+   }
+
+   return no;
+}
+
+//***************************************************************************
+// mask
+//***************************************************************************
+
+int KeywordFilter::mask(char* text, int len, char maskChar) const
+{
+   // returns number of matches
+
+   const unsigned char* p= (const unsigned char*)text;
+   int state= 0, count= 0;
+
+   if (patterns.empty())
+      return 0;
+
+   for (int i= 0; i < len; i++)
+   {
+      state= next[state * classes + classOf[p[i]]];
+
+      // the automaton already consumed the byte, masking behind us is safe
+
+      if (output[state])
+      {
+         memset(text + i - output[state] + 1, maskChar, output[state]);
+         count++;
+      }
+   }
+
+   return count;
+}
+
+//***************************************************************************
+// current
+//***************************************************************************
+
+std::shared_ptr<const KeywordFilter> KeywordFilter::current()
+{
+   std::shared_ptr<const KeywordFilter> res;
+
+   activeMutex.lock();
+   res= active;
+   activeMutex.unlock();
+
+   return res;
+}
+
+//***************************************************************************
+// reload
+//***************************************************************************
+
+int KeywordFilter::reload()
+{
+   // on failure the previous filter stays active
+
+   if (!Globals::cfgFilterFile)
+      return done;
+
+   std::shared_ptr<KeywordFilter> filter= std::make_shared<KeywordFilter>();
+
+   if (filter->load(Globals::cfgFilterFile) != success)
+      return fail;
+
+   printf("Filter: Loaded %d pattern(s) from '%s' (%d states)\n",
+          filter->getCount(), Globals::cfgFilterFile, filter->getStates());
+
+   activeMutex.lock();
+   active= filter;
+   activeMutex.unlock();
+
+   return success;
+}
+
+//***************************************************************************
+// action of
+//***************************************************************************
+
+int KeywordFilter::actionOf(const char* name)
+{
+   if (!strcmp(name, "drop")) return faDrop;
+   if (!strcmp(name, "mask")) return faMask;
+   if (!strcmp(name, "tag"))  return faTag;
+
+   return na;
+}
@@ -0,0 +1,72 @@
+//***************************************************************************
+// File filter.hpp
+// Date 18.10.26 - #1
+// Copyright (c) 2017-2026 s710 (s710 (at) posteo (dot) de). All rights reserved.
+// --------------------------------------------------------------------------
+// Ark ClusterChat / keyword filter (Aho-Corasick)
+//***************************************************************************
+
+#ifndef __FILTER_HPP__
+#define __FILTER_HPP__
+
+#include <memory>
+#include <string>
+#include <vector>
+
+#include "thread.hpp"
+
+//***************************************************************************
+// class KeywordFilter
+//***************************************************************************
+// all patterns are compiled into one case folded (ASCII) automaton, so a
+// message is scanned in a single pass regardless of the number of
+// patterns. bytes not used by any pattern share one input class, which
+// keeps the transition table small (states x classes).
+//
+// the active filter is immutable once built, a reload builds a new one
+// and swaps it. readers keep their snapshot until they are done.
+//***************************************************************************
+
+class KeywordFilter
+{
+   public:
+
+      enum Action
+      {
+         faDrop,            // don't relay the message
+         faMask,            // replace matches by '*'
+         faTag              // relay unchanged, log it
+      };
+
+      KeywordFilter();
+
+      int add(const char* pattern, int len);
+      int load(const char* path);
+      int build();
+
+      int getCount() const { return patterns.size(); }
+      int getStates() const { return output.size(); }
+
+      int match(const char* text, int len) const;
+      int mask(char* text, int len, char maskChar= '*') const;
+
+      // active filter
+
+      static std::shared_ptr<const KeywordFilter> current();
+      static int reload();
+      static int actionOf(const char* name);
+
+   protected:
+
+      unsigned char classOf[256];
+      int classes;
+      std::vector<int> next;            // [state * classes + class]
+      std::vector<int> output;          // longest pattern ending in state, 0 if none
+      std::vector<std::string> patterns;
+
+      static Mutex activeMutex;
+      static std::shared_ptr<const KeywordFilter> active;
+};
+
+//***************************************************************************
+#endif // __FILTER_HPP__
@@ -0,0 +1,194 @@
+//***************************************************************************
+// File floodctl.cc
+// Date 18.10.26 - #1
+// Copyright (c) 2017-2026 s710 (s710 (at) posteo (dot) de). All rights reserved.
+// --------------------------------------------------------------------------
+// Ark ClusterChat / per player flood control
+//***************************************************************************
+
+#include <stdio.h>
+
+#include "floodctl.hpp"
+#include "def.h"
+
+#define STALE_MS (10 * 60 * 1000ULL)
+
+//***************************************************************************
+// hash (FNV-1a)
+//***************************************************************************
+
+static unsigned long long hash(std::string_view text)
+{
+   unsigned long long h= 14695981039346656037ULL;
+
+   for (size_t i= 0; i < text.size(); i++)
+      h= (h ^ (unsigned char)text[i]) * 1099511628211ULL;
+
+   return h;
+}
+
+//***************************************************************************
+// class FloodControl
+//***************************************************************************
+
+FloodControl::FloodControl()
+{
+   for (int i= 0; i < FLOOD_SLOTS; i++)
+   {
+      slots[i].key= 0;
+      slots[i].lastSeen= 0;
+      slots[i].repeats= 0;
+   }
+
+   limited= 0;
+   repeated= 0;
+}
+
+//***************************************************************************
+// lookup
+//***************************************************************************
+
+FloodControl::Entry* FloodControl::lookup(unsigned long long key, unsigned long long now)
+{
+   Entry* victim= 0;
+
+   for (int p= 0; p < FLOOD_PROBES; p++)
+   {
+      Entry* e= &slots[(key + p) & (FLOOD_SLOTS - 1)];
+
+      if (e->key == key)
+         return e;
+
+      // prefer free, then stale, then least recently seen
+
+      if (!victim || (victim->key && (!e->key || e->lastSeen < victim->lastSeen)))
+         victim= e;
+   }
+
+   victim->key= key;
+   victim->lastText= 0;
+   victim->lastSeen= now;
+   victim->tokens= Globals::cfgFloodBurst;
+   victim->repeats= 0;
+   victim->sender.clear();
+
+   return victim;
+}
+
+//***************************************************************************
+// summarize
+//***************************************************************************
+
+void FloodControl::summarize(Entry* e, std::string* summary)
+{
+   char tmp[100];
+
+   snprintf(tmp, sizeof(tmp), "(last message repeated %d time%s)", e->repeats, e->repeats > 1 ? "s" : "");
+
+   summary->assign(e->sender);
+   summary->append(tmp);
+   e->repeats= 0;
+}
+
+//***************************************************************************
+// check
+//***************************************************************************
+
+int FloodControl::check(const char* text, const ChatLine* fields, unsigned long long now, std::string* summary)
+{
+   // summary is set if a collapsed repeat has to be reported before this message
+
+   summary->clear();
+
+   if (!fields->isStructured())
+      return frPass;
+
+   Entry* e= lookup(hash(fields->steamName.view(text)) | 1, now);
+   unsigned long long textHash= hash(fields->body.view(text));
+
+   if (Globals::cfgCollapseRepeats && e->lastText == textHash
+       && now - e->lastSeen <= Globals::cfgCollapseRepeats * 1000ULL)
+   {
+      // lastSeen moves on, credit the time up to now first
+
+      refill(e, now);
+      e->repeats++;
+      repeated++;
+
+      return frRepeated;
+   }
+
+   if (e->repeats)
+      summarize(e, summary);
+
+   e->lastText= textHash;
+   e->sender.assign(text, fields->body.offset);
+
+   // token bucket
+
+   if (Globals::cfgFloodRate)
+   {
+      refill(e, now);
+
+      if (e->tokens < 1.0)
+      {
+         limited++;
+         return frLimited;
+      }
+
+      e->tokens-= 1.0;
+   }
+
+   e->lastSeen= now;
+
+   return frPass;
+}
+
+//***************************************************************************
+// refill
+//***************************************************************************
+
+void FloodControl::refill(Entry* e, unsigned long long now)
+{
+   // token bucket, refilled by the time passed since the last message
+
+   if (Globals::cfgFloodRate)
+   {
+      e->tokens+= (now - e->lastSeen) * Globals::cfgFloodRate / 60000.0;
+
+      if (e->tokens > Globals::cfgFloodBurst)
+         e->tokens= Globals::cfgFloodBurst;
+   }
+
+   e->lastSeen= now;
+}
+
+//***************************************************************************
+// flush
+//***************************************************************************
+
+int FloodControl::flush(unsigned long long now, std::vector<std::string>* summaries)
+{
+   // summaries of players who stopped repeating themselves
+
+   summaries->clear();
+
+   if (!Globals::cfgCollapseRepeats)
+      return 0;
+
+   for (int i= 0; i < FLOOD_SLOTS; i++)
+   {
+      Entry* e= &slots[i];
+
+      if (e->key && now - e->lastSeen > STALE_MS && !e->repeats)
+         e->key= 0;
+
+      if (e->key && e->repeats && now - e->lastSeen > Globals::cfgCollapseRepeats * 1000ULL)
+      {
+         summaries->push_back(std::string());
+         summarize(e, &summaries->back());
+      }
+   }
+
+   return summaries->size();
+}
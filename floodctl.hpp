@@ -0,0 +1,73 @@
+//***************************************************************************
+// File floodctl.hpp
+// Date 18.10.26 - #1
+// Copyright (c) 2017-2026 s710 (s710 (at) posteo (dot) de). All rights reserved.
+// --------------------------------------------------------------------------
+// Ark ClusterChat / per player flood control
+//***************************************************************************
+
+#ifndef __FLOODCTL_HPP__
+#define __FLOODCTL_HPP__
+
+#include <string>
+#include <vector>
+
+#include "chatline.hpp"
+
+#define FLOOD_SLOTS  512      // power of 2
+#define FLOOD_PROBES 8
+
+//***************************************************************************
+// class FloodControl
+//***************************************************************************
+// one per source server, only used by its reading thread (no locking).
+// players are kept in a small open addressing table, keyed by a hash of
+// the steam name. each has a token bucket (--flood-rate per minute, up to
+// --flood-burst) and the hash of its last message. identical consecutive
+// messages are suppressed and reported as one summary line once the
+// player says something else or --collapse-repeats seconds have passed.
+// stale or least recently seen entries are evicted when probing fails.
+//***************************************************************************
+
+class FloodControl
+{
+   public:
+
+      enum Result
+      {
+         frPass,
+         frLimited,          // rate exceeded
+         frRepeated          // same as the last message
+      };
+
+      FloodControl();
+
+      int check(const char* text, const ChatLine* fields, unsigned long long now, std::string* summary);
+      int flush(unsigned long long now, std::vector<std::string>* summaries);
+
+      unsigned long long getLimited()  { return limited; }
+      unsigned long long getRepeated() { return repeated; }
+
+   protected:
+
+      struct Entry
+      {
+         unsigned long long key;        // 0 - free
+         unsigned long long lastText;   // hash of last message
+         unsigned long long lastSeen;   // [ms]
+         double tokens;
+         int repeats;
+         std::string sender;            // "Name (Char): " for summaries
+      };
+
+      Entry* lookup(unsigned long long key, unsigned long long now);
+      void summarize(Entry* e, std::string* summary);
+      void refill(Entry* e, unsigned long long now);
+
+      Entry slots[FLOOD_SLOTS];
+      unsigned long long limited;
+      unsigned long long repeated;
+};
+
+//***************************************************************************
+#endif // __FLOODCTL_HPP__
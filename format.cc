@@ -0,0 +1,228 @@
+//***************************************************************************
+// File format.cc
+// Date 18.10.26 - #1
+// Copyright (c) 2017-2026 s710 (s710 (at) posteo (dot) de). All rights reserved.
+// --------------------------------------------------------------------------
+// Ark ClusterChat / outbound message templates
+//***************************************************************************
+
+#include <stdio.h>
+#include <algorithm>
+#include <string.h>
+
+#include "format.hpp"
+#include "utf8.hpp"
+#include "def.h"
+
+//***************************************************************************
+// class MessageFormat
+//***************************************************************************
+
+std::map<std::string, std::unique_ptr<MessageFormat> > MessageFormat::formats;
+
+//***************************************************************************
+// get
+//***************************************************************************
+
+const MessageFormat* MessageFormat::get(const char* templ)
+{
+   std::map<std::string, std::unique_ptr<MessageFormat> >::iterator it= formats.find(templ);
+
+   if (it != formats.end())
+      return it->second.get();
+
+   std::unique_ptr<MessageFormat> format(new MessageFormat);
+
+   if (format->compile(templ) != success)
+      return 0;
+
+   return (formats[templ]= std::move(format)).get();
+}
+
+//***************************************************************************
+// compile
+//***************************************************************************
+
+int MessageFormat::compile(const char* aTempl)
+{
+   static const char* fields[]= { "", "server", "message", "player", "character", "channel", "body", 0 };
+   const char* p= aTempl;
+
+   templ.assign(aTempl);
+   literals.clear();
+   ops.clear();
+   addLiteral("ServerChat ", 11);
+
+   while (*p)
+   {
+      const char* b= strchr(p, '{');
+
+      if (!b)
+      {
+         addLiteral(p, strlen(p));
+         break;
+      }
+
+      addLiteral(p, b - p);
+
+      if (b[1] == '{')
+      {
+         addLiteral(b, 1);
+         p= b + 2;
+         continue;
+      }
+
+      const char* e= strchr(b, '}');
+      int f;
+
+      for (f= 1; e && fields[f]; f++)
+         if ((int)strlen(fields[f]) == e - b - 1 && !strncmp(b + 1, fields[f], e - b - 1))
+            break;
+
+      if (!e || !fields[f])
+      {
+         fprintf(stderr, "Error: Unknown field '%.*s' in format '%s'\n",
+                 e ? (int)(e - b + 1) : (int)strlen(b), b, aTempl);
+         return fail;
+      }
+
+      ops.push_back(Op{f, 0, 0});
+      p= e + 1;
+   }
+
+   return success;
+}
+
+//***************************************************************************
+// add literal
+//***************************************************************************
+
+void MessageFormat::addLiteral(const char* text, int len)
+{
+   if (!len)
+      return;
+
+   // adjacent literals become one copy
+
+   if (ops.size() && ops.back().field == ffLiteral)
+      ops.back().length+= len;
+   else
+      ops.push_back(Op{ffLiteral, (int)literals.size(), len});
+
+   literals.append(text, len);
+}
+
+//***************************************************************************
+// append
+//***************************************************************************
+
+void MessageFormat::append(std::string* out, const Message* message, int bodyOffset, int bodyLength) const
+{
+   const char* text= message->text.c_str();
+   const ChatLine& line= message->line;
+
+   for (size_t i= 0; i < ops.size(); i++)
+   {
+      const Op& op= ops[i];
+
+      switch (op.field)
+      {
+         case ffLiteral:   out->append(literals, op.offset, op.length); break;
+         case ffServer:    out->append(message->server); break;
+         case ffPlayer:    out->append(line.steamName.view(text)); break;
+         case ffCharacter: out->append(line.characterName.view(text)); break;
+         case ffChannel:   out->append(line.channel.view(text)); break;
+         case ffBody:      out->append(text + bodyOffset, bodyLength); break;
+
+         case ffMessage:
+         {
+            // sender as received, then the (part of the) body
+
+            out->append(text, line.body.offset);
+            out->append(text + bodyOffset, bodyLength);
+            break;
+         }
+      }
+   }
+}
+
+//***************************************************************************
+// overhead
+//***************************************************************************
+
+int MessageFormat::overhead(const Message* message, int* bodies) const
+{
+   // length of a command without its body, and how often the body is in
+
+   const ChatLine& line= message->line;
+   int res= 0;
+
+   *bodies= 0;
+
+   for (size_t i= 0; i < ops.size(); i++)
+   {
+      switch (ops[i].field)
+      {
+         case ffLiteral:   res+= ops[i].length; break;
+         case ffServer:    res+= message->server.size(); break;
+         case ffPlayer:    res+= line.steamName.length; break;
+         case ffCharacter: res+= line.characterName.length; break;
+         case ffChannel:   res+= line.channel.length; break;
+         case ffBody:      (*bodies)++; break;
+         case ffMessage:   res+= line.body.offset; (*bodies)++; break;
+      }
+   }
+
+   return res;
+}
+
+//***************************************************************************
+// format
+//***************************************************************************
+
+int MessageFormat::format(const Message* message, int maxLength, Commands* commands) const
+{
+   // commands longer than maxLength are split at code point boundaries,
+   // each part is a command of its own
+
+   const char* text= message->text.c_str();
+   int len= message->text.length();
+   int offset= message->line.body.offset;
+   int budget= 0;
+
+   commands->clear();
+
+   // the template and the sender are repeated on every part, only the
+   // rest is left for the body. at least one code point per part.
+   // without a body in the template there is nothing to split, budget 0
+   // gives one command
+
+   if (maxLength > 0)
+   {
+      int bodies;
+      int rest= maxLength - overhead(message, &bodies);
+
+      if (bodies)
+         budget= std::max(rest / bodies, 1);
+   }
+
+   do
+   {
+      int part= len - offset;
+
+      if (budget)
+         part= Utf8::split(text + offset, len - offset, budget);
+
+      commands->push_back(std::string());
+      commands->back().reserve(literals.size() + message->server.size() + len);
+      append(&commands->back(), message, offset, part);
+
+      offset+= part;
+
+      while (offset < len && text[offset] == ' ')
+         offset++;
+
+   } while (offset < len);
+
+   return commands->size();
+}
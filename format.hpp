@@ -0,0 +1,91 @@
+//***************************************************************************
+// File format.hpp
+// Date 18.10.26 - #1
+// Copyright (c) 2017-2026 s710 (s710 (at) posteo (dot) de). All rights reserved.
+// --------------------------------------------------------------------------
+// Ark ClusterChat / outbound message templates
+//***************************************************************************
+
+#ifndef __FORMAT_HPP__
+#define __FORMAT_HPP__
+
+#include <map>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include "chatline.hpp"
+
+#define DEFAULT_FORMAT "[{server}] {message}"
+
+//***************************************************************************
+// struct Message
+//***************************************************************************
+// one received chat line, shared by all destinations
+//***************************************************************************
+
+struct Message
+{
+   std::string text;
+   std::string server;      // title of the source server
+   ChatLine line;           // fields of 'text'
+   unsigned long long id;         // source index << 40 | sequence
+   unsigned long long ingested;   // [us] monotonic, when GetChat returned it
+   int source;                    // index of the source server
+};
+
+typedef std::vector<std::string> Commands;
+
+//***************************************************************************
+// class MessageFormat
+//***************************************************************************
+// template text with fields {server} {message} {player} {character}
+// {channel} {body}, '{{' for a literal brace. parsed once into literal
+// and field copy ops, equal templates share one instance, so a message
+// is formatted once per template, not once per destination.
+// get() is meant for startup, it is not thread safe.
+//***************************************************************************
+
+class MessageFormat
+{
+   public:
+
+      static const MessageFormat* get(const char* templ);
+
+      int format(const Message* message, int maxLength, Commands* commands) const;
+      const char* getTemplate() const { return templ.c_str(); }
+
+   protected:
+
+      enum Field
+      {
+         ffLiteral,
+         ffServer,
+         ffMessage,
+         ffPlayer,
+         ffCharacter,
+         ffChannel,
+         ffBody
+      };
+
+      struct Op
+      {
+         int field;
+         int offset;         // literal: into 'literals'
+         int length;
+      };
+
+      int compile(const char* aTempl);
+      void addLiteral(const char* text, int len);
+      void append(std::string* out, const Message* message, int bodyOffset, int bodyLength) const;
+      int overhead(const Message* message, int* bodies) const;
+
+      std::string templ;
+      std::string literals;
+      std::vector<Op> ops;
+
+      static std::map<std::string, std::unique_ptr<MessageFormat> > formats;
+};
+
+//***************************************************************************
+#endif // __FORMAT_HPP__
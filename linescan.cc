@@ -0,0 +1,246 @@
+//***************************************************************************
+// File linescan.cc
+// Date 18.10.26 - #1
+// Copyright (c) 2017-2026 s710 (s710 (at) posteo (dot) de). All rights reserved.
+// --------------------------------------------------------------------------
+// Ark ClusterChat / line splitting and classification of GetChat output
+//***************************************************************************
+
+#include <string.h>
+#include <stdint.h>
+
+#if defined(__x86_64__) || defined(__i386__)
+#  include <immintrin.h>
+#  define HAVE_X86_SIMD
+#endif
+
+#include "linescan.hpp"
+
+//***************************************************************************
+// classify
+//***************************************************************************
+
+static inline uint64_t prefix8(const char* s)
+{
+   uint64_t v;
+   memcpy(&v, s, sizeof(v));
+   return v;
+}
+
+static const uint64_t prefixServer= prefix8("SERVER: ");
+static const uint64_t prefixAdmin= prefix8("AdminCmd");
+
+static inline void addLine(const char* buffer, int start, int end, std::vector<LineSpan>* lines)
+{
+   LineSpan span;
+
+   if (end <= start)
+      return;
+
+   span.offset= start;
+   span.length= end - start;
+   span.kind= lkChat;
+
+   // one 8 byte compare per line instead of strncmp() per destination
+
+   if (span.length >= 8)
+   {
+      uint64_t p= prefix8(buffer + start);
+
+      if (p == prefixServer)
+         span.kind= lkServer;
+      else if (p == prefixAdmin)
+         span.kind= lkAdmin;
+   }
+
+   lines->push_back(span);
+}
+
+//***************************************************************************
+// scalar
+//***************************************************************************
+
+static int scanScalar(const char* buffer, int len, std::vector<LineSpan>* lines)
+{
+   int start= 0;
+   const char* p;
+
+   while (start < len && (p= (const char*)memchr(buffer + start, '\n', len - start)))
+   {
+      addLine(buffer, start, p - buffer, lines);
+      start= p - buffer + 1;
+   }
+
+   addLine(buffer, start, len, lines);
+
+   return lines->size();
+}
+
+#ifdef HAVE_X86_SIMD
+
+//***************************************************************************
+// SSE2
+//***************************************************************************
+
+__attribute__((target("sse2")))
+static int scanSse2(const char* buffer, int len, std::vector<LineSpan>* lines)
+{
+   const __m128i nl= _mm_set1_epi8('\n');
+   int start= 0, i= 0;
+
+   for (; i + 16 <= len; i+= 16)
+   {
+      __m128i chunk= _mm_loadu_si128((const __m128i*)(buffer + i));
+      unsigned int mask= _mm_movemask_epi8(_mm_cmpeq_epi8(chunk, nl));
+
+      while (mask)
+      {
+         int pos= i + __builtin_ctz(mask);
+
+         addLine(buffer, start, pos, lines);
+         start= pos + 1;
+         mask&= mask - 1;
+      }
+   }
+
+   for (; i < len; i++)
+   {
+      if (buffer[i] == '\n')
+      {
+         addLine(buffer, start, i, lines);
+         start= i + 1;
+      }
+   }
+
+   addLine(buffer, start, len, lines);
+
+   return lines->size();
+}
+
+//***************************************************************************
+// AVX2
+//***************************************************************************
+
+__attribute__((target("avx2")))
+static int scanAvx2(const char* buffer, int len, std::vector<LineSpan>* lines)
+{
+   const __m256i nl= _mm256_set1_epi8('\n');
+   int start= 0, i= 0;
+
+   for (; i + 32 <= len; i+= 32)
+   {
+      __m256i chunk= _mm256_loadu_si256((const __m256i*)(buffer + i));
+      unsigned int mask= _mm256_movemask_epi8(_mm256_cmpeq_epi8(chunk, nl));
+
+      while (mask)
+      {
+         int pos= i + __builtin_ctz(mask);
+
+         addLine(buffer, start, pos, lines);
+         start= pos + 1;
+         mask&= mask - 1;
+      }
+   }
+
+   for (; i < len; i++)
+   {
+      if (buffer[i] == '\n')
+      {
+         addLine(buffer, start, i, lines);
+         start= i + 1;
+      }
+   }
+
+   addLine(buffer, start, len, lines);
+
+   return lines->size();
+}
+
+#endif // HAVE_X86_SIMD
+
+//***************************************************************************
+// class LineScanner
+//***************************************************************************
+
+LineScanner::ScanFunction LineScanner::function= LineScanner::select();
+
+//***************************************************************************
+// select
+//***************************************************************************
+
+LineScanner::ScanFunction LineScanner::select()
+{
+#ifdef HAVE_X86_SIMD
+   __builtin_cpu_init();
+
+   if (__builtin_cpu_supports("avx2"))
+      return scanAvx2;
+
+   if (__builtin_cpu_supports("sse2"))
+      return scanSse2;
+#endif
+
+   return scanScalar;
+}
+
+//***************************************************************************
+// get implementation
+//***************************************************************************
+
+const char* LineScanner::getImplementation()
+{
+#ifdef HAVE_X86_SIMD
+   if (function == scanAvx2)
+      return "avx2";
+
+   if (function == scanSse2)
+      return "sse2";
+#endif
+
+   return "scalar";
+}
+
+//***************************************************************************
+// scan
+//***************************************************************************
+
+int LineScanner::scan(const char* buffer, int len, std::vector<LineSpan>* lines)
+{
+   lines->clear();
+
+   return function(buffer, len, lines);
+}
+
+//***************************************************************************
+// class LineAssembler
+//***************************************************************************
+// feed
+//***************************************************************************
+
+int LineAssembler::feed(const char* data, int len, int complete)
+{
+   // returns number of complete lines, see getLines()
+
+   buffer.erase(0, consumed);
+   buffer.append(data, len);
+
+   LineScanner::scan(buffer.data(), buffer.size(), &lines);
+   consumed= buffer.size();
+
+   // keep an unterminated last line (ends at the end of the buffer) for
+   // the next response, unless the tail alone is already too long
+
+   if (!complete && lines.size())
+   {
+      const LineSpan& last= lines.back();
+      size_t tail= buffer.size() - last.offset;
+
+      if (tail == (size_t)last.length && tail < MAX_TAIL)
+      {
+         consumed= last.offset;
+         lines.pop_back();
+      }
+   }
+
+   return lines.size();
+}
@@ -0,0 +1,87 @@
+//***************************************************************************
+// File linescan.hpp
+// Date 18.10.26 - #1
+// Copyright (c) 2017-2026 s710 (s710 (at) posteo (dot) de). All rights reserved.
+// --------------------------------------------------------------------------
+// Ark ClusterChat / line splitting and classification of GetChat output
+//***************************************************************************
+
+#ifndef __LINESCAN_HPP__
+#define __LINESCAN_HPP__
+
+#include <string>
+#include <vector>
+
+#define MAX_TAIL (64*1024)     // longer unterminated lines are emitted anyway
+
+//***************************************************************************
+// struct LineSpan
+//***************************************************************************
+
+enum LineKind
+{
+   lkChat,          // player chat
+   lkServer,        // "SERVER: ..." echo of our own ServerChat
+   lkAdmin          // "AdminCmd: ..."
+};
+
+struct LineSpan
+{
+   int offset;
+   int length;      // without '\n'
+   int kind;        // LineKind
+};
+
+//***************************************************************************
+// class LineScanner
+//***************************************************************************
+// finds all line boundaries in one pass (AVX2 / SSE2 / scalar, selected
+// at runtime) and classifies each line once. empty lines are skipped.
+//***************************************************************************
+
+class LineScanner
+{
+   public:
+
+      static int scan(const char* buffer, int len, std::vector<LineSpan>* lines);
+      static const char* getImplementation();
+
+   protected:
+
+      typedef int (*ScanFunction)(const char* buffer, int len, std::vector<LineSpan>* lines);
+
+      static ScanFunction select();
+      static ScanFunction function;
+};
+
+//***************************************************************************
+// class LineAssembler
+//***************************************************************************
+// per connection. a response which was cut (see RConChannel::isTruncated)
+// may end in the middle of a line, that tail is kept and completed by
+// the next response instead of being relayed as two broken messages.
+// the tail is moved to the front of one buffer, which is reused.
+//***************************************************************************
+
+class LineAssembler
+{
+   public:
+
+      LineAssembler() { consumed= 0; }
+
+      int feed(const char* data, int len, int complete);
+      void reset() { buffer.clear(); lines.clear(); consumed= 0; }
+
+      char* getBuffer() { return &buffer[0]; }
+      const std::vector<LineSpan>& getLines() { return lines; }
+      int getPending() { return buffer.size() - consumed; }
+
+   protected:
+
+      std::string buffer;
+      std::vector<LineSpan> lines;
+      size_t consumed;        // bytes of 'buffer' emitted by the last feed
+};
+
+//***************************************************************************
+#endif // __LINESCAN_HPP__
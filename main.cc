@@ -15,7 +15,12 @@
 
 #include "def.h"
 #include "clusterchat.hpp"
+#include "filter.hpp"
+#include "rules.hpp"
 #include "thread.hpp"
+#include "trace.hpp"
+#include "alloc.hpp"
+#include "capture.hpp"
 #include "ini.h"
 
 //***************************************************************************
@@ -25,7 +30,7 @@
 #define VERSION "1.1"
 
 CondVar mainCond;
-Mutex mainMutex;
+Mutex mainMutex("Main");
 int shouldExit = no;
 char* lastSection= 0;
 ServerConfig* lastConfig= 0;
@@ -36,10 +41,6 @@ int doCommandline(int argc, char* argv[], std::list<ServerConfig*>* configs);
 int parseServer(char* string, ServerConfig* cfg);
 int iniHandler(void* user, const char* section, const char* name, const char* value);
 
-int Globals::cfgVerbose= 0;
-int Globals::cfgDebug= 0;
-int Globals::cfgShowAdmin= 0;
-
 //***************************************************************************
 // signal processing
 //***************************************************************************
@@ -55,6 +56,27 @@ static void* sig_thread(void *arg)
       {
          printf("[SIG Handler] Got signal: %s\n", strsignal(sig));
 
+         if (sig == SIGHUP)
+         {
+            KeywordFilter::reload();
+            RuleSet::reload();
+            continue;
+         }
+
+         if (sig == SIGUSR1)
+         {
+            Mutex::dumpStats();
+            continue;
+         }
+
+         if (sig == SIGUSR2)
+         {
+            if (Globals::cfgTraceFile)
+               Trace::dump(Globals::cfgTraceFile);
+
+            continue;
+         }
+
          if (sig == SIGINT || sig == SIGTERM || sig == SIGQUIT)
          {
             printf("[SIG Handler] Exiting ...\n");
@@ -92,7 +114,11 @@ int main(int argc, char* argv[])
    for (std::list<ServerConfig*>::iterator it= configs.begin(); it != configs.end(); ++it)
       printf("Main:  - %s@%s:%d\n", (*it)->title.c_str(), (*it)->host.c_str(), (*it)->port);
 
-   printf("Main: Starting (show admin cmd: %d, debug: %d, verbose: %d).\n", Globals::cfgShowAdmin, Globals::cfgDebug, Globals::cfgVerbose);
+   printf("Main: Starting (show admin cmd: %d, debug: %d, verbose: %d, split channels: %d).\n",
+          Globals::cfgShowAdmin, Globals::cfgDebug, Globals::cfgVerbose, Globals::cfgSplitChannels);
+
+   if (KeywordFilter::reload() != success)
+      return fail;
 
    mainMutex.lock();
 
@@ -107,6 +133,9 @@ int main(int argc, char* argv[])
    sigaddset(&set, SIGQUIT);
    sigaddset(&set, SIGTERM);
    sigaddset(&set, SIGINT);
+   sigaddset(&set, SIGHUP);
+   sigaddset(&set, SIGUSR1);
+   sigaddset(&set, SIGUSR2);
 
    pthread_sigmask(SIG_BLOCK, &set, NULL);
    pthread_create(&handleThread, NULL, &sig_thread, (void *) &set);
@@ -120,13 +149,37 @@ int main(int argc, char* argv[])
       return -1;
    }
 
+   int replayDone= no;
+
    while (!shouldExit)
-      mainCond.timedWait(mainMutex, 3);
+   {
+      mainCond.timedWait(mainMutex, Globals::cfgAllocReport ? Globals::cfgAllocReport : 3);
+
+      if (Globals::cfgAllocReport && !shouldExit)
+         AllocStats::report();
+
+      // capture consumed, exit like on SIGINT once we wait for mainCond
+      // again, pending messages are drained by shutdown
+
+      if (Globals::cfgReplayFile && Replay::finished() && !replayDone)
+      {
+         printf("Main: Replay finished\n");
+         pthread_kill(handleThread, SIGINT);
+         replayDone= yes;
+      }
+   }
 
    printf("Main: Exiting.\n");
 
+   // the signal thread sets shouldExit before it takes mainMutex
+
+   mainMutex.unlock();
    pthread_join(handleThread, 0);
-   clusterChat.shutdown();
+
+   // allocation limit exceeded (--alloc-limit)
+
+   if (clusterChat.shutdown() == fail)
+      return 2;
 
    return 0;
 }
@@ -148,12 +201,78 @@ int doHelp()
    printf("                     game chat as well as application log. Make sure to use your server RCON port.'\n\n");
    printf("      -c [FILE]      Path to ini configuration file with server descriptions (as alternative to -s option).\n\n");
    printf("      --verbose      Print all messages sent/received.\n");
-   printf("      --debug        Send chat messages ONLY to the server they have been received on.\n\n");
+   printf("      --debug        Send chat messages ONLY to the server they have been received on.\n");
+   printf("      --split-channels\n");
+   printf("                     Use separate RCON connections for reading and sending chat (default: disabled).\n");
+   printf("      --drain-timeout [SEC]\n");
+   printf("                     Time to deliver pending messages on shutdown (default: 5).\n");
+   printf("      --rcon-timeout [SEC]\n");
+   printf("                     RCON send/receive timeout, 0 to block forever (default: 10).\n");
+   printf("      --reconnect-min [MS], --reconnect-max [MS]\n");
+   printf("                     Reconnect back-off range, doubled on each failure (default: 1000, 60000).\n");
+   printf("      --breaker-threshold [N]\n");
+   printf("                     Stop relaying chat to a server after N failed attempts in a row (default: 3).\n");
+   printf("      --dns-ttl [SEC]\n");
+   printf("                     Time resolved host addresses are cached, refreshed in background (default: 300).\n");
+   printf("      --filter [FILE]\n");
+   printf("                     Keyword filter, one word per line (case insensitive). Reloaded on SIGHUP.\n");
+   printf("      --filter-action [drop|mask|tag]\n");
+   printf("                     Drop matching messages, mask the matches or relay and log them (default: drop).\n");
+   printf("      --rules [FILE]\n");
+   printf("                     Relay rules, one per line: allow|deny [from SERVER,..] [to SERVER,..] [if CONDITION].\n");
+   printf("                     See README for the condition syntax. Reloaded on SIGHUP.\n");
+   printf("      --max-message-length [BYTES]\n");
+   printf("                     Split messages into commands of at most BYTES (including format and sender),\n");
+   printf("                     0 to disable (default: 0).\n");
+   printf("      --format [TEMPLATE]\n");
+   printf("                     Format of relayed messages, fields: {server} {message} {player} {character}\n");
+   printf("                     {channel} {body} (default: '%s').\n", DEFAULT_FORMAT);
+   printf("      --warmup [relay|discard|last:N|age:SEC]\n");
+   printf("                     What to do with chat buffered by the server before (re)connect: relay it,\n");
+   printf("                     discard it, relay the last N lines, or relay it only if we were away\n");
+   printf("                     at most SEC seconds (default: relay).\n");
+   printf("      --flood-rate [N], --flood-burst [N]\n");
+   printf("                     Relay at most N messages per minute per player, with bursts of up to\n");
+   printf("                     --flood-burst messages, 0 to disable (default: 0, 5).\n");
+   printf("      --collapse-repeats [SEC]\n");
+   printf("                     Relay identical consecutive messages of a player once, followed by a\n");
+   printf("                     'repeated N times' line after SEC seconds of silence, 0 to disable (default: 0).\n");
+   printf("      --reorder-window [MS]\n");
+   printf("                     Hold relayed messages up to MS ms and deliver them in the order they\n");
+   printf("                     were received from all servers, 0 to disable (default: 0).\n");
+   printf("      --metrics-port [PORT]\n");
+   printf("                     Serve counters and latency histograms in Prometheus format on\n");
+   printf("                     http://127.0.0.1:PORT/metrics (default: 0, off).\n");
+   printf("      --trace [FILE] Record I/O, queue lock, formatting and relay spans of every thread, written\n");
+   printf("                     to FILE in Chrome trace format on SIGUSR2 (default: off).\n");
+   printf("      --latency-matrix [FILE]\n");
+   printf("                     Write the latency of every source/destination pair to FILE (CSV) on\n");
+   printf("                     shutdown, they are also exported with --metrics-port (default: off).\n");
+   printf("      --alloc-report [SEC]\n");
+   printf("                     Print allocations per second and live heap per subsystem every SEC\n");
+   printf("                     seconds, requires 'make ALLOCSTATS=1' (default: 0, off).\n");
+   printf("      --alloc-limit [N]\n");
+   printf("                     Exit with status 2 if the relay path made more than N allocations per\n");
+   printf("                     delivered message, requires 'make ALLOCSTATS=1' (default: off).\n");
+   printf("      --watchdog [SEC]\n");
+   printf("                     Force a reconnect of a server thread without progress for SEC seconds,\n");
+   printf("                     e.g. blocked in a receive. Keep it above --rcon-timeout (default: 60, 0 off).\n");
+   printf("      --capture [FILE]\n");
+   printf("                     Record every GetChat response and command sent, with timestamps, to FILE\n");
+   printf("                     (default: off).\n");
+   printf("      --replay [FILE]\n");
+   printf("                     Relay the responses of a capture instead of connecting to the servers,\n");
+   printf("                     the servers are taken from FILE. Exits when the capture is done.\n");
+   printf("      --replay-speed [X]\n");
+   printf("                     Replay X times faster than recorded, 'max' as fast as possible\n");
+   printf("                     (default: 1).\n\n");
    printf("The configuration file should have the following contents PER SERVER:\n\n");
    printf(" [(TITLE)]\n");
    printf(" host = (HOSTNAME)\n");
    printf(" port = (RCONPORT)\n");
-   printf(" password = (RCONPASSWORD)\n\n");
+   printf(" password = (RCONPASSWORD)\n");
+   printf(" format = (TEMPLATE)         (optional, see --format)\n");
+   printf(" warmup = (POLICY)           (optional, see --warmup)\n\n");
    printf(" Example:\n\n");
    printf(" [TheIsland]\n");
    printf(" host = 123.123.123.123\n");
@@ -230,6 +349,179 @@ int doCommandline(int argc, char* argv[], std::list<ServerConfig*>* configs)
          Globals::cfgShowAdmin= 1;
          continue;
       }
+
+      if (!strcmp(argv[i], "--split-channels"))
+      {
+         Globals::cfgSplitChannels= 1;
+         continue;
+      }
+
+      if (!strcmp(argv[i], "--drain-timeout") && argv[i+1])
+      {
+         Globals::cfgDrainTimeout= atoi(argv[++i]);
+         continue;
+      }
+
+      if (!strcmp(argv[i], "--rcon-timeout") && argv[i+1])
+      {
+         Globals::cfgRconTimeout= atoi(argv[++i]);
+         continue;
+      }
+
+      if (!strcmp(argv[i], "--reconnect-min") && argv[i+1])
+      {
+         Globals::cfgReconnectMin= atoi(argv[++i]);
+         continue;
+      }
+
+      if (!strcmp(argv[i], "--reconnect-max") && argv[i+1])
+      {
+         Globals::cfgReconnectMax= atoi(argv[++i]);
+         continue;
+      }
+
+      if (!strcmp(argv[i], "--breaker-threshold") && argv[i+1])
+      {
+         Globals::cfgBreakerThreshold= atoi(argv[++i]);
+         continue;
+      }
+
+      if (!strcmp(argv[i], "--dns-ttl") && argv[i+1])
+      {
+         Globals::cfgDnsTtl= atoi(argv[++i]);
+         continue;
+      }
+
+      if (!strcmp(argv[i], "--filter") && argv[i+1])
+      {
+         Globals::cfgFilterFile= argv[++i];
+         continue;
+      }
+
+      if (!strcmp(argv[i], "--flood-rate") && argv[i+1])
+      {
+         Globals::cfgFloodRate= atoi(argv[++i]);
+         continue;
+      }
+
+      if (!strcmp(argv[i], "--flood-burst") && argv[i+1])
+      {
+         Globals::cfgFloodBurst= atoi(argv[++i]);
+         continue;
+      }
+
+      if (!strcmp(argv[i], "--collapse-repeats") && argv[i+1])
+      {
+         Globals::cfgCollapseRepeats= atoi(argv[++i]);
+         continue;
+      }
+
+      if (!strcmp(argv[i], "--reorder-window") && argv[i+1])
+      {
+         Globals::cfgReorderWindow= atoi(argv[++i]);
+         continue;
+      }
+
+      if (!strcmp(argv[i], "--metrics-port") && argv[i+1])
+      {
+         Globals::cfgMetricsPort= atoi(argv[++i]);
+         continue;
+      }
+
+      if (!strcmp(argv[i], "--trace") && argv[i+1])
+      {
+         Globals::cfgTraceFile= argv[++i];
+         Trace::enabled= yes;
+         continue;
+      }
+
+      if (!strcmp(argv[i], "--latency-matrix") && argv[i+1])
+      {
+         Globals::cfgLatencyMatrix= argv[++i];
+         continue;
+      }
+
+      if (!strcmp(argv[i], "--watchdog") && argv[i+1])
+      {
+         Globals::cfgWatchdog= atoi(argv[++i]);
+         continue;
+      }
+
+      if (!strcmp(argv[i], "--capture") && argv[i+1])
+      {
+         Globals::cfgCaptureFile= argv[++i];
+         continue;
+      }
+
+      if (!strcmp(argv[i], "--replay") && argv[i+1])
+      {
+         Globals::cfgReplayFile= argv[++i];
+         continue;
+      }
+
+      if (!strcmp(argv[i], "--replay-speed") && argv[i+1])
+      {
+         Globals::cfgReplaySpeed= !strcmp(argv[i+1], "max") ? 0 : atof(argv[i+1]);
+         i++;
+         continue;
+      }
+
+      if (!strcmp(argv[i], "--alloc-report") && argv[i+1])
+      {
+         Globals::cfgAllocReport= atoi(argv[++i]);
+         continue;
+      }
+
+      if (!strcmp(argv[i], "--alloc-limit") && argv[i+1])
+      {
+         Globals::cfgAllocLimit= atof(argv[++i]);
+         continue;
+      }
+
+      if (!strcmp(argv[i], "--warmup") && argv[i+1])
+      {
+         if (RConThread::parseWarmup(argv[++i], &Globals::cfgWarmup, &Globals::cfgWarmupValue) != success)
+            return fail;
+
+         continue;
+      }
+
+      if (!strcmp(argv[i], "--format") && argv[i+1])
+      {
+         Globals::cfgFormat= argv[++i];
+         continue;
+      }
+
+      if (!strcmp(argv[i], "--max-message-length") && argv[i+1])
+      {
+         Globals::cfgMaxMessageLength= atoi(argv[++i]);
+         continue;
+      }
+
+      if (!strcmp(argv[i], "--rules") && argv[i+1])
+      {
+         Globals::cfgRulesFile= argv[++i];
+         continue;
+      }
+
+      if (!strcmp(argv[i], "--filter-action") && argv[i+1])
+      {
+         Globals::cfgFilterAction= KeywordFilter::actionOf(argv[++i]);
+
+         if (Globals::cfgFilterAction == na)
+         {
+            fprintf(stderr, "Error: Unknown filter action '%s'\n", argv[i]);
+            return fail;
+         }
+
+         continue;
+      }
+   }
+
+   if ((Globals::cfgAllocReport || Globals::cfgAllocLimit >= 0) && !AllocStats::available())
+   {
+      fprintf(stderr, "Error: Allocation statistics require a build with 'make ALLOCSTATS=1'\n");
+      return fail;
    }
 
    if (configFile)
@@ -248,6 +540,41 @@ int doCommandline(int argc, char* argv[], std::list<ServerConfig*>* configs)
       }
    }
 
+   // replay: the servers of the capture, settings of a configured server with the same title
+
+   if (Globals::cfgReplayFile)
+   {
+      std::list<ServerConfig*> configured;
+
+      if (Replay::load(Globals::cfgReplayFile, Globals::cfgReplaySpeed) != success)
+         return fail;
+
+      configured.swap(*configs);
+
+      for (size_t t= 0; t < Replay::getTitles().size(); t++)
+      {
+         ServerConfig* cfg= new ServerConfig();
+
+         cfg->title= Replay::getTitles()[t];
+         cfg->host= "replay";
+         cfg->port= 0;
+
+         for (std::list<ServerConfig*>::iterator it= configured.begin(); it != configured.end(); ++it)
+         {
+            if ((*it)->title == cfg->title)
+            {
+               cfg->format= (*it)->format;
+               cfg->warmup= (*it)->warmup;
+            }
+         }
+
+         configs->push_back(cfg);
+      }
+
+      for (std::list<ServerConfig*>::iterator it= configured.begin(); it != configured.end(); ++it)
+         delete *it;
+   }
+
    return done;
 }
 
@@ -333,6 +660,8 @@ int iniHandler(void* user, const char* section, const char* name, const char* va
    if (!strcmp(name, "host")) lastConfig->host.assign(value);
    else if (!strcmp(name, "password")) lastConfig->password.assign(value);
    else if (!strcmp(name, "port")) lastConfig->port= atoi(value);
+   else if (!strcmp(name, "format")) lastConfig->format.assign(value);
+   else if (!strcmp(name, "warmup")) lastConfig->warmup.assign(value);
 
    return 1;
 }
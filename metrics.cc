@@ -0,0 +1,427 @@
+//***************************************************************************
+// File metrics.cc
+// Date 18.10.26 - #1
+// Copyright (c) 2017-2026 s710 (s710 (at) posteo (dot) de). All rights reserved.
+// --------------------------------------------------------------------------
+// Ark ClusterChat / counters, histograms and Prometheus endpoint
+//***************************************************************************
+
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+#include <poll.h>
+#include <errno.h>
+
+#include <sys/types.h>
+#include <sys/socket.h>
+#include <sys/time.h>
+#include <netinet/in.h>
+#include <arpa/inet.h>
+
+#include "metrics.hpp"
+
+#define HTTP_OK "HTTP/1.0 200 OK\r\nContent-Type: text/plain; version=0.0.4\r\nConnection: close\r\n\r\n"
+#define HTTP_NOT_FOUND "HTTP/1.0 404 Not Found\r\nContent-Type: text/plain\r\nConnection: close\r\n\r\nNot found\n"
+
+Mutex MetricsServer::mutex("Metrics");
+std::list<ServerMetrics*> MetricsServer::registry;
+
+//***************************************************************************
+// class Histogram
+//***************************************************************************
+// observe
+//***************************************************************************
+
+void Histogram::observe(unsigned long long us)
+{
+   int i= us <= (1ULL << HIST_FIRST) ? 0 : 64 - __builtin_clzll(us - 1) - HIST_FIRST;
+
+   buckets[i < HIST_BUCKETS ? i : HIST_BUCKETS].add();
+   sum.add(us);
+}
+
+//***************************************************************************
+// print
+//***************************************************************************
+
+void Histogram::print(std::string* out, const char* name, const char* server) const
+{
+   char line[256];
+   unsigned long long count= 0;
+
+   for (int i= 0; i <= HIST_BUCKETS; i++)
+   {
+      count+= buckets[i].get();
+
+      if (i < HIST_BUCKETS)
+         snprintf(line, sizeof(line), "%s_bucket{server=\"%s\",le=\"%g\"} %llu\n",
+                  name, server, (double)(1ULL << (HIST_FIRST + i)) / 1000000.0, count);
+      else
+         snprintf(line, sizeof(line), "%s_bucket{server=\"%s\",le=\"+Inf\"} %llu\n", name, server, count);
+
+      out->append(line);
+   }
+
+   snprintf(line, sizeof(line), "%s_sum{server=\"%s\"} %.6f\n%s_count{server=\"%s\"} %llu\n",
+            name, server, sum.get() / 1000000.0, name, server, count);
+   out->append(line);
+}
+
+//***************************************************************************
+// class MetricsServer
+//***************************************************************************
+// ctor/dtor
+//***************************************************************************
+
+MetricsServer::MetricsServer()
+{
+   lsock= na;
+   port= 0;
+}
+
+MetricsServer::~MetricsServer()
+{
+   stop();
+   exit();
+}
+
+//***************************************************************************
+// attach / detach
+//***************************************************************************
+
+void MetricsServer::attach(ServerMetrics* metrics)
+{
+   mutex.lock();
+   registry.push_back(metrics);
+   mutex.unlock();
+}
+
+void MetricsServer::detach(ServerMetrics* metrics)
+{
+   mutex.lock();
+   registry.remove(metrics);
+   mutex.unlock();
+}
+
+//***************************************************************************
+// open
+//***************************************************************************
+
+int MetricsServer::open(int aPort)
+{
+   sockaddr_in addr;
+   int on= 1;
+
+   lsock= socket(AF_INET, SOCK_STREAM, 0);
+
+   if (lsock < 0)
+   {
+      fprintf(stderr, "Metrics: Error: Failed to create socket (%d / %s)\n", errno, strerror(errno));
+      lsock= na;
+      return fail;
+   }
+
+   setsockopt(lsock, SOL_SOCKET, SO_REUSEADDR, &on, sizeof(on));
+
+   memset(&addr, 0, sizeof(addr));
+   addr.sin_family= AF_INET;
+   addr.sin_port= htons(aPort);
+   addr.sin_addr.s_addr= htonl(INADDR_LOOPBACK);
+
+   if (bind(lsock, (sockaddr*)&addr, sizeof(addr)) || listen(lsock, 16))
+   {
+      fprintf(stderr, "Metrics: Error: Failed to listen on port %d (%d / %s)\n", aPort, errno, strerror(errno));
+      ::close(lsock);
+      lsock= na;
+      return fail;
+   }
+
+   port= aPort;
+   printf("Metrics: Listening on http://127.0.0.1:%d/metrics\n", port);
+
+   return start();
+}
+
+//***************************************************************************
+// exit
+//***************************************************************************
+
+int MetricsServer::exit()
+{
+   if (lsock != na)
+      ::close(lsock);
+
+   lsock= na;
+
+   return done;
+}
+
+//***************************************************************************
+// run
+//***************************************************************************
+
+int MetricsServer::run()
+{
+   setThreadName("metrics");
+
+   while (!isState(isExit))
+   {
+      pollfd p;
+      int sock;
+
+      p.fd= lsock;
+      p.events= POLLIN;
+      p.revents= 0;
+
+      if (::poll(&p, 1, 500) <= 0)
+         continue;
+
+      if ((sock= ::accept(lsock, 0, 0)) < 0)
+         continue;
+
+      serve(sock);
+      ::close(sock);
+   }
+
+   return done;
+}
+
+//***************************************************************************
+// serve
+//***************************************************************************
+
+int MetricsServer::serve(int sock)
+{
+   // request line is all we need, give slow clients one second
+
+   char request[1024];
+   int len= 0, res;
+   std::string out;
+   timeval tv= { 1, 0 };
+
+   setsockopt(sock, SOL_SOCKET, SO_RCVTIMEO, &tv, sizeof(tv));
+   setsockopt(sock, SOL_SOCKET, SO_SNDTIMEO, &tv, sizeof(tv));
+
+   while (len < (int)sizeof(request) - 1 && (res= ::recv(sock, request + len, sizeof(request) - 1 - len, 0)) > 0)
+   {
+      len+= res;
+      request[len]= 0;
+
+      if (strstr(request, "\r\n\r\n") || strstr(request, "\n\n"))
+         break;
+   }
+
+   request[len]= 0;
+
+   if (!strncmp(request, "GET /metrics ", 13) || !strncmp(request, "GET /metrics?", 13))
+   {
+      out.assign(HTTP_OK);
+      render(&out);
+   }
+   else
+      out.assign(HTTP_NOT_FOUND);
+
+   for (size_t sent= 0; sent < out.size(); sent+= res)
+      if ((res= ::send(sock, out.data() + sent, out.size() - sent, MSG_NOSIGNAL)) <= 0)
+         return fail;
+
+   return success;
+}
+
+//***************************************************************************
+// render
+//***************************************************************************
+
+void MetricsServer::render(std::string* out)
+{
+   struct Series
+   {
+      const char* name;
+      const char* type;
+      const char* help;
+      Counter ServerMetrics::* counter;                           // or
+      std::function<unsigned long long()> ServerMetrics::* value;
+   };
+
+   static const Series series[]=
+   {
+      { "arkcc_lines_ingested_total",     "counter", "Chat lines read from the server",         &ServerMetrics::ingested,   0 },
+      { "arkcc_lines_relayed_total",      "counter", "Copies of the server's lines queued",     &ServerMetrics::relayed,    0 },
+      { "arkcc_messages_delivered_total", "counter", "Messages sent to the server",             &ServerMetrics::delivered,  0 },
+      { "arkcc_messages_dropped_total",   "counter", "Messages for the server given up",        &ServerMetrics::dropped,    0 },
+      { "arkcc_reconnects_total",         "counter", "Connection attempts after a failure",     &ServerMetrics::reconnects, 0 },
+      { "arkcc_watchdog_resets_total",    "counter", "Reconnects forced by the watchdog",       &ServerMetrics::stalls,     0 },
+      { "arkcc_bytes_received_total",     "counter", "RCON bytes received",                     &ServerMetrics::bytesIn,    0 },
+      { "arkcc_bytes_sent_total",         "counter", "RCON bytes sent",                         &ServerMetrics::bytesOut,   0 },
+      { "arkcc_heartbeats_total",         "counter", "Main loop iterations of the server's threads", 0, &ServerMetrics::heartbeats },
+      { "arkcc_queue_depth",              "gauge",   "Messages waiting for the server",         0, &ServerMetrics::queueDepth }
+   };
+
+   char line[256];
+
+   mutex.lock();
+
+   for (size_t s= 0; s < sizeof(series) / sizeof(series[0]); s++)
+   {
+      snprintf(line, sizeof(line), "# HELP %s %s\n# TYPE %s %s\n", series[s].name, series[s].help, series[s].name, series[s].type);
+      out->append(line);
+
+      for (std::list<ServerMetrics*>::iterator it= registry.begin(); it != registry.end(); ++it)
+      {
+         unsigned long long value;
+
+         if (series[s].counter)
+            value= ((*it)->*series[s].counter).get();
+         else
+            value= (*it)->*series[s].value ? ((*it)->*series[s].value)() : 0;
+
+         snprintf(line, sizeof(line), "%s{server=\"%s\"} %llu\n", series[s].name, (*it)->server.c_str(), value);
+         out->append(line);
+      }
+   }
+
+   out->append("# HELP arkcc_thread_cpu_seconds_total CPU time of the server's thread(s)\n# TYPE arkcc_thread_cpu_seconds_total counter\n");
+
+   for (std::list<ServerMetrics*>::iterator it= registry.begin(); it != registry.end(); ++it)
+   {
+      snprintf(line, sizeof(line), "arkcc_thread_cpu_seconds_total{server=\"%s\"} %.6f\n", (*it)->server.c_str(),
+               (*it)->cpuTime ? (*it)->cpuTime() / 1000000.0 : 0);
+      out->append(line);
+   }
+
+   out->append("# HELP arkcc_e2e_seconds Ingest on the source to ServerChat acknowledged by the server\n# TYPE arkcc_e2e_seconds histogram\n");
+
+   for (std::list<ServerMetrics*>::iterator it= registry.begin(); it != registry.end(); ++it)
+      (*it)->endToEnd.print(out, "arkcc_e2e_seconds", (*it)->server.c_str());
+
+   renderPaths(out);
+
+   out->append("# HELP arkcc_getchat_seconds GetChat round trip\n# TYPE arkcc_getchat_seconds histogram\n");
+
+   for (std::list<ServerMetrics*>::iterator it= registry.begin(); it != registry.end(); ++it)
+      (*it)->getChat.print(out, "arkcc_getchat_seconds", (*it)->server.c_str());
+
+   out->append("# HELP arkcc_serverchat_seconds ServerChat round trip\n# TYPE arkcc_serverchat_seconds histogram\n");
+
+   for (std::list<ServerMetrics*>::iterator it= registry.begin(); it != registry.end(); ++it)
+      (*it)->serverChat.print(out, "arkcc_serverchat_seconds", (*it)->server.c_str());
+
+   mutex.unlock();
+}
+
+//***************************************************************************
+// names
+//***************************************************************************
+
+void MetricsServer::names(std::vector<const char*>* titles)
+{
+   // server titles by index, registry lock is held by the caller
+
+   titles->clear();
+
+   for (std::list<ServerMetrics*>::iterator it= registry.begin(); it != registry.end(); ++it)
+   {
+      if ((int)titles->size() <= (*it)->index)
+         titles->resize((*it)->index + 1, "");
+
+      (*titles)[(*it)->index]= (*it)->server.c_str();
+   }
+}
+
+//***************************************************************************
+// render paths
+//***************************************************************************
+
+void MetricsServer::renderPaths(std::string* out)
+{
+   // source/destination pairs which carried messages only
+
+   struct Series
+   {
+      const char* name;
+      const char* type;
+      const char* help;
+      Counter PathLatency::* counter;
+      double scale;
+   };
+
+   static const Series series[]=
+   {
+      { "arkcc_path_messages_total",        "counter", "Messages delivered from one server to another",     &PathLatency::count,    1 },
+      { "arkcc_path_queue_seconds_total",   "counter", "Time spent queued, enqueue to dequeue",             &PathLatency::queued,   1e-6 },
+      { "arkcc_path_send_seconds_total",    "counter", "Time spent sending, dequeue to acknowledged",       &PathLatency::sent,     1e-6 },
+      { "arkcc_path_latency_seconds_total", "counter", "Time from ingest to acknowledged",                  &PathLatency::total,    1e-6 },
+      { "arkcc_path_latency_max_seconds",   "gauge",   "Longest time from ingest to acknowledged",          &PathLatency::maxTotal, 1e-6 }
+   };
+
+   std::vector<const char*> titles;
+   char line[512];
+
+   names(&titles);
+
+   for (size_t s= 0; s < sizeof(series) / sizeof(series[0]); s++)
+   {
+      snprintf(line, sizeof(line), "# HELP %s %s\n# TYPE %s %s\n", series[s].name, series[s].help, series[s].name, series[s].type);
+      out->append(line);
+
+      for (std::list<ServerMetrics*>::iterator it= registry.begin(); it != registry.end(); ++it)
+      {
+         for (int from= 0; from < (*it)->pathCount && from < (int)titles.size(); from++)
+         {
+            const PathLatency& path= (*it)->paths[from];
+
+            if (!path.count.get())
+               continue;
+
+            snprintf(line, sizeof(line), "%s{from=\"%s\",to=\"%s\"} %.6g\n", series[s].name,
+                     titles[from], (*it)->server.c_str(), (path.*series[s].counter).get() * series[s].scale);
+            out->append(line);
+         }
+      }
+   }
+}
+
+//***************************************************************************
+// write matrix
+//***************************************************************************
+
+int MetricsServer::writeMatrix(const char* path)
+{
+   std::vector<const char*> titles;
+   FILE* f= fopen(path, "w");
+   int count= 0;
+
+   if (!f)
+   {
+      fprintf(stderr, "Metrics: Error: Failed to open '%s' (%s)\n", path, strerror(errno));
+      return fail;
+   }
+
+   fprintf(f, "from,to,messages,queue_avg_ms,send_avg_ms,latency_avg_ms,latency_max_ms\n");
+
+   mutex.lock();
+   names(&titles);
+
+   for (std::list<ServerMetrics*>::iterator it= registry.begin(); it != registry.end(); ++it)
+   {
+      for (int from= 0; from < (*it)->pathCount && from < (int)titles.size(); from++)
+      {
+         const PathLatency& p= (*it)->paths[from];
+         double n= p.count.get();
+
+         if (!n)
+            continue;
+
+         fprintf(f, "%s,%s,%llu,%.3f,%.3f,%.3f,%.3f\n", titles[from], (*it)->server.c_str(), p.count.get(),
+                 p.queued.get() / n / 1000, p.sent.get() / n / 1000, p.total.get() / n / 1000, p.maxTotal.get() / 1000.0);
+         count++;
+      }
+   }
+
+   mutex.unlock();
+   fclose(f);
+
+   printf("Metrics: Wrote latency of %d path(s) to '%s'\n", count, path);
+
+   return success;
+}
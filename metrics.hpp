@@ -0,0 +1,156 @@
+//***************************************************************************
+// File metrics.hpp
+// Date 18.10.26 - #1
+// Copyright (c) 2017-2026 s710 (s710 (at) posteo (dot) de). All rights reserved.
+// --------------------------------------------------------------------------
+// Ark ClusterChat / counters, histograms and Prometheus endpoint
+//***************************************************************************
+
+#ifndef __METRICS_HPP__
+#define __METRICS_HPP__
+
+#include <atomic>
+#include <functional>
+#include <list>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include "thread.hpp"
+
+#define HIST_FIRST   7        // first bucket bound 2^7 us
+#define HIST_BUCKETS 20       // up to 2^26 us (67 s), plus +Inf
+
+//***************************************************************************
+// class Counter
+//***************************************************************************
+// relaxed, each counter is written by one thread only (or a few rarely).
+// scrapes may see a slightly old value, never a torn one.
+//***************************************************************************
+
+class Counter
+{
+   public:
+
+      Counter() : value(0) {}
+
+      void add(unsigned long long n= 1) { value.fetch_add(n, std::memory_order_relaxed); }
+      void max(unsigned long long n)    { if (n > get()) value.store(n, std::memory_order_relaxed); }   // single writer
+      unsigned long long get() const    { return value.load(std::memory_order_relaxed); }
+
+   private:
+
+      std::atomic<unsigned long long> value;
+};
+
+//***************************************************************************
+// class Histogram
+//***************************************************************************
+// latency [us] in power of 2 buckets, bucket i counts values up to
+// 2^(HIST_FIRST+i). cumulative counts are only built on scrape.
+//***************************************************************************
+
+class Histogram
+{
+   public:
+
+      void observe(unsigned long long us);
+      void print(std::string* out, const char* name, const char* server) const;
+
+   private:
+
+      Counter buckets[HIST_BUCKETS + 1];
+      Counter sum;
+};
+
+//***************************************************************************
+// struct PathLatency
+//***************************************************************************
+// messages from one source to one destination [us], kept by the
+// destination: queued - enqueue to dequeue (includes the reorder window),
+// sent - dequeue to ServerChat acknowledged, total - ingest to acknowledged
+//***************************************************************************
+
+struct PathLatency
+{
+   Counter count;
+   Counter queued;
+   Counter sent;
+   Counter total;
+   Counter maxTotal;
+};
+
+//***************************************************************************
+// struct ServerMetrics
+//***************************************************************************
+// one per server, owned by its RConThread. the reading thread updates
+// the ingest side, the writing thread (the same unless split) the
+// delivery side, so the hot path never shares a cache line with peers.
+//***************************************************************************
+
+struct ServerMetrics
+{
+   std::string server;
+   Counter ingested;          // chat lines read from this server
+   Counter relayed;           // copies queued to other servers
+   Counter delivered;         // messages sent to this server
+   Counter dropped;           // messages for this server given up
+   Counter reconnects;
+   Counter stalls;            // reconnects forced by the watchdog
+   Counter bytesIn;
+   Counter bytesOut;
+   Histogram getChat;         // round trip [us]
+   Histogram serverChat;      // round trip [us]
+   Histogram endToEnd;        // ingest on the source to ServerChat to this server [us]
+   std::unique_ptr<PathLatency[]> paths;   // by source index
+   int pathCount;
+   int index;
+   std::function<unsigned long long()> queueDepth;
+   std::function<unsigned long long()> heartbeats;   // loops of its thread(s)
+   std::function<unsigned long long()> cpuTime;      // of its thread(s) [us]
+
+   ServerMetrics() { pathCount= 0; index= 0; }
+
+   void setPaths(int count) { paths.reset(new PathLatency[count]); pathCount= count; }
+};
+
+//***************************************************************************
+// class MetricsServer
+//***************************************************************************
+// minimal HTTP listener on localhost (--metrics-port), answers
+// 'GET /metrics' in Prometheus text format. one request at a time,
+// the registry lock is only taken while a scrape is rendered.
+//***************************************************************************
+
+class MetricsServer : public Thread
+{
+   public:
+
+      MetricsServer();
+      virtual ~MetricsServer();
+
+      int open(int aPort);
+      int stop() { return Thread::stop(); }
+
+      static void attach(ServerMetrics* metrics);
+      static void detach(ServerMetrics* metrics);
+      static void render(std::string* out);
+      static int writeMatrix(const char* path);
+
+   protected:
+
+      int run();
+      int exit();
+      int serve(int sock);
+      static void names(std::vector<const char*>* titles);
+      static void renderPaths(std::string* out);
+
+      int lsock;
+      int port;
+
+      static Mutex mutex;
+      static std::list<ServerMetrics*> registry;
+};
+
+//***************************************************************************
+#endif // __METRICS_HPP__
@@ -0,0 +1,521 @@
+//***************************************************************************
+// File mockrcon.cc
+// Date 18.10.26 - #1
+// Copyright (c) 2017-2026 s710 (s710 (at) posteo (dot) de). All rights reserved.
+// --------------------------------------------------------------------------
+// Ark ClusterChat / mock ARK RCON server (benchmarks)
+//***************************************************************************
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <errno.h>
+#include <algorithm>
+
+#include <sys/types.h>
+#include <sys/socket.h>
+#include <netinet/in.h>
+#include <arpa/inet.h>
+
+#include "mockrcon.hpp"
+#include "channel.hpp"
+
+#define NO_RESPONSE "Server received, But no response!! \n"
+#define STAMP " t="      // creation time [us] of generated lines
+#define SENDER "Bench"   // default sender, latency is recorded for these only
+
+//***************************************************************************
+// struct MockFaults
+//***************************************************************************
+// parse
+//***************************************************************************
+
+int MockFaults::parse(const char* spec)
+{
+   memset(this, 0, sizeof(*this));
+
+   for (const char* p= spec; p && *p; p= strchr(p, ',') ? strchr(p, ',') + 1 : 0)
+   {
+      const char* value= strchr(p, '=');
+
+      if (!value)
+         return fail;
+
+      value++;
+
+      if (!strncmp(p, "delay=", 6))         delay= atoi(value);
+      else if (!strncmp(p, "stall=", 6))    stallEvery= atoi(value), stallFor= strchr(value, ':') ? atoi(strchr(value, ':') + 1) : 0;
+      else if (!strncmp(p, "reset=", 6))    resetEvery= atoi(value);
+      else if (!strncmp(p, "hang=", 5))     hangEvery= atoi(value);
+      else if (!strncmp(p, "partial=", 8))  partialEvery= atoi(value);
+      else if (!strncmp(p, "truncate=", 9)) truncateEvery= atoi(value);
+      else if (!strncmp(p, "bogus=", 6))    bogusEvery= atoi(value);
+      else if (!strncmp(p, "auth=", 5))     authEvery= atoi(value);
+      else
+         return fail;
+   }
+
+   return success;
+}
+
+//***************************************************************************
+// class MockRConServer
+//***************************************************************************
+// ctor/dtor
+//***************************************************************************
+
+MockRConServer::MockRConServer()
+{
+   lsock= na;
+   port= 0;
+   commands= 0;
+   chatRate= 0;
+   replyDelay= 0;
+   logins= 0;
+   replies= 0;
+   sender= SENDER;
+   memset(&faults, 0, sizeof(faults));
+}
+
+MockRConServer::~MockRConServer()
+{
+   stop();
+   exit();
+}
+
+//***************************************************************************
+// open
+//***************************************************************************
+
+int MockRConServer::open(int aPort, const char* aPasswd)
+{
+   sockaddr_in addr;
+   socklen_t len= sizeof(addr);
+   int on= 1;
+
+   passwd.assign(aPasswd ? aPasswd : "");
+
+   lsock= socket(AF_INET, SOCK_STREAM, 0);
+
+   if (lsock < 0)
+   {
+      fprintf(stderr, "Error: Failed to create socket (%d / %s)\n", errno, strerror(errno));
+      lsock= na;
+      return fail;
+   }
+
+   setsockopt(lsock, SOL_SOCKET, SO_REUSEADDR, &on, sizeof(on));
+
+   memset(&addr, 0, sizeof(addr));
+   addr.sin_family= AF_INET;
+   addr.sin_port= htons(aPort);
+   addr.sin_addr.s_addr= htonl(INADDR_LOOPBACK);
+
+   if (bind(lsock, (sockaddr*)&addr, sizeof(addr)) || listen(lsock, 1024))
+   {
+      fprintf(stderr, "Error: Failed to listen on port %d (%d / %s)\n", aPort, errno, strerror(errno));
+      ::close(lsock);
+      lsock= na;
+      return fail;
+   }
+
+   getsockname(lsock, (sockaddr*)&addr, &len);
+   port= ntohs(addr.sin_port);
+
+   fcntl(lsock, F_SETFL, fcntl(lsock, F_GETFL, 0) | O_NONBLOCK);
+
+   return start();
+}
+
+//***************************************************************************
+// exit
+//***************************************************************************
+
+int MockRConServer::exit()
+{
+   while (connections.size())
+      close(connections.size() - 1);
+
+   if (lsock != na)
+      ::close(lsock);
+
+   lsock= na;
+
+   return done;
+}
+
+//***************************************************************************
+// run
+//***************************************************************************
+
+int MockRConServer::run()
+{
+   std::vector<pollfd> fds;
+
+   while (!isState(isExit))
+   {
+      pollfd p;
+      unsigned long long now= usNow();
+      int timeout= 100;
+
+      // delayed replies are due
+
+      for (size_t i= 0; i < connections.size(); i++)
+      {
+         Connection* conn= connections[i];
+
+         while (conn->delayed.size() && conn->delayed.front().first <= now)
+         {
+            conn->out.append(conn->delayed.front().second);
+            conn->delayed.pop_front();
+         }
+
+         if (conn->delayed.size())
+            timeout= std::min(timeout, (int)((conn->delayed.front().first - now) / 1000) + 1);
+      }
+
+      fds.clear();
+      p.fd= lsock;
+      p.events= POLLIN;
+      p.revents= 0;
+      fds.push_back(p);
+
+      for (size_t i= 0; i < connections.size(); i++)
+      {
+         p.fd= connections[i]->sock;
+         p.events= POLLIN | (connections[i]->out.size() ? POLLOUT : 0);
+         fds.push_back(p);
+      }
+
+      if (::poll(&fds[0], fds.size(), timeout) <= 0)
+         continue;
+
+      // connections only get appended/removed below, walk backwards
+
+      for (size_t i= fds.size() - 1; i > 0; i--)
+      {
+         Connection* conn= connections[i-1];
+
+         if (fds[i].revents & (POLLIN | POLLERR | POLLHUP))
+         {
+            if (onReadable(conn) != success)
+            {
+               close(i-1);
+               continue;
+            }
+         }
+
+         if (conn->out.size())
+         {
+            ssize_t res= ::send(conn->sock, conn->out.data(), conn->out.size(), 0);
+
+            if (res < 0 && errno != EAGAIN && errno != EWOULDBLOCK)
+            {
+               close(i-1);
+               continue;
+            }
+            else if (res > 0)
+               conn->out.erase(0, res);
+         }
+
+         if (conn->closing && conn->out.empty() && conn->delayed.empty())
+            close(i-1);
+      }
+
+      if (fds[0].revents & POLLIN)
+         accept();
+   }
+
+   return done;
+}
+
+//***************************************************************************
+// accept
+//***************************************************************************
+
+int MockRConServer::accept()
+{
+   int sock;
+
+   while ((sock= ::accept(lsock, 0, 0)) >= 0)
+   {
+      Connection* conn= new Connection;
+
+      fcntl(sock, F_SETFL, fcntl(sock, F_GETFL, 0) | O_NONBLOCK);
+
+      conn->sock= sock;
+      conn->authenticated= no;
+      conn->nextLine= usNow();
+      conn->seq= 0;
+      conn->count= 0;
+      conn->hung= no;
+      conn->closing= no;
+      connections.push_back(conn);
+   }
+
+   return done;
+}
+
+//***************************************************************************
+// close
+//***************************************************************************
+
+void MockRConServer::close(size_t index)
+{
+   ::close(connections[index]->sock);
+   delete connections[index];
+
+   connections.erase(connections.begin() + index);
+}
+
+//***************************************************************************
+// on readable
+//***************************************************************************
+
+int MockRConServer::onReadable(Connection* conn)
+{
+   char buffer[4096];
+   ssize_t res= ::recv(conn->sock, buffer, sizeof(buffer), 0);
+
+   if (res < 0 && (errno == EAGAIN || errno == EWOULDBLOCK))
+      return success;
+
+   if (res <= 0)
+      return fail;
+
+   conn->in.append(buffer, res);
+
+   // size, id, cmd, body\0\0
+
+   while (conn->in.size() >= sizeof(int))
+   {
+      int size, id, cmd;
+      memcpy(&size, conn->in.data(), sizeof(int));
+
+      if (size < 10 || size > BUFFSIZE_MAX)
+         return fail;
+
+      if (conn->in.size() < sizeof(int) + size)
+         break;
+
+      memcpy(&id, conn->in.data() + sizeof(int), sizeof(int));
+      memcpy(&cmd, conn->in.data() + 2*sizeof(int), sizeof(int));
+
+      std::string body(conn->in.data() + 3*sizeof(int), size - 2*sizeof(int) - 2);
+
+      conn->in.erase(0, sizeof(int) + size);
+
+      if (onPacket(conn, id, cmd, body.c_str()) != success)
+         return fail;
+   }
+
+   return success;
+}
+
+//***************************************************************************
+// on packet
+//***************************************************************************
+
+int MockRConServer::onPacket(Connection* conn, int id, int cmd, const char* body)
+{
+   commands++;
+   conn->count++;
+
+   if (conn->hung || conn->closing)
+      return success;
+
+   if (cmd == RC_AUTHENTICATE)
+   {
+      logins++;
+      conn->authenticated= (passwd.empty() || passwd == body) && !(faults.authEvery && logins % faults.authEvery == 0);
+      reply(conn, conn->authenticated ? id : -1, RC_AUTH_RESPONSE, "", 0);
+
+      return success;
+   }
+
+   if (!conn->authenticated)
+      return fail;
+
+   // mirrored like Source servers do, marks the end of a split response
+
+   if (cmd == RC_RESPONSE)
+   {
+      reply(conn, id, RC_RESPONSE, "", 0);
+      return success;
+   }
+
+   if (faults.resetEvery && conn->count % faults.resetEvery == 0)
+      return reset(conn);
+
+   if (faults.hangEvery && conn->count % faults.hangEvery == 0)
+   {
+      conn->hung= yes;
+      return success;
+   }
+
+   if (!strcmp(body, "GetChat") && chatRate > 0)
+   {
+      std::string text;
+
+      generate(conn, &text);
+
+      if (text.size())
+         reply(conn, id, 0, text.c_str(), text.size());
+      else
+         reply(conn, id, 0, NO_RESPONSE, strlen(NO_RESPONSE));
+
+      return success;
+   }
+
+   if (!strcmp(body, "GetChat") && chat.size())
+   {
+      // longer responses are split into packets of RCON_PACKET_MAX
+
+      for (size_t offset= 0; offset < chat.size(); offset+= RCON_PACKET_MAX)
+         reply(conn, id, 0, chat.c_str() + offset, std::min(chat.size() - offset, (size_t)RCON_PACKET_MAX));
+   }
+   else
+      reply(conn, id, 0, NO_RESPONSE, strlen(NO_RESPONSE), replyDelay);
+
+   // a relayed generated line, ends with its creation time
+
+   const char* stamp= !strncmp(body, "ServerChat ", 11) ? strstr(body, STAMP) : 0;
+
+   if (stamp && strstr(body, "] " SENDER))
+   {
+      unsigned long long created= strtoull(stamp + strlen(STAMP), 0, 10);
+
+      latencyMutex.lock();
+      latencies.push_back((unsigned)(usNow() - created));
+      latencyMutex.unlock();
+   }
+
+   return success;
+}
+
+//***************************************************************************
+// generate
+//***************************************************************************
+
+void MockRConServer::generate(Connection* conn, std::string* text)
+{
+   // all lines due since the last GetChat, a single packet at most
+
+   unsigned long long now= usNow();
+   unsigned long long interval= (unsigned long long)(1000000 / chatRate);
+   char line[128];
+
+   while (conn->nextLine <= now && text->size() + sizeof(line) < RCON_PACKET_MAX)
+   {
+      snprintf(line, sizeof(line), "%s%d (Survivor): message %llu" STAMP "%llu\n",
+               sender.c_str(), conn->sock, conn->seq++, conn->nextLine);
+      text->append(line);
+      conn->nextLine+= interval;
+   }
+}
+
+//***************************************************************************
+// take latencies
+//***************************************************************************
+
+void MockRConServer::takeLatencies(std::vector<unsigned>* aLatencies)
+{
+   aLatencies->clear();
+
+   latencyMutex.lock();
+   latencies.swap(*aLatencies);
+   latencyMutex.unlock();
+}
+
+//***************************************************************************
+// reply
+//***************************************************************************
+
+void MockRConServer::reply(Connection* conn, int id, int cmd, const char* body, int len, int delay)
+{
+   int size= sizeof(int) * 2 + len + 2;
+   std::string packet;
+
+   packet.append((const char*)&size, sizeof(int));
+   packet.append((const char*)&id, sizeof(int));
+   packet.append((const char*)&cmd, sizeof(int));
+   packet.append(body, len);
+   packet.append(2, '\0');
+
+   unsigned long long due= usNow() + delay * 1000ULL;
+
+   if (conn->authenticated && faults.any())
+      inject(conn, &packet, &due);
+
+   // replies stay in order
+
+   if (conn->delayed.size())
+      due= std::max(due, conn->delayed.back().first);
+
+   if (due > usNow())
+      conn->delayed.push_back(std::make_pair(due, packet));
+   else
+      conn->out.append(packet);
+}
+
+//***************************************************************************
+// inject
+//***************************************************************************
+
+void MockRConServer::inject(Connection* conn, std::string* packet, unsigned long long* due)
+{
+   unsigned long long now= usNow();
+
+   replies++;
+   *due+= faults.delay * 1000ULL;
+
+   // stalled for the first 'stallFor' ms of every period
+
+   if (faults.stallEvery)
+   {
+      unsigned long long period= faults.stallEvery * 1000000ULL;
+      unsigned long long phase= now % period;
+
+      if (phase < faults.stallFor * 1000ULL)
+         *due= std::max(*due, now - phase + faults.stallFor * 1000ULL);
+   }
+
+   if (faults.bogusEvery && replies % faults.bogusEvery == 0)
+   {
+      int size= replies / faults.bogusEvery % 2 ? 0x7fffffff : 3;
+      packet->replace(0, sizeof(int), (const char*)&size, sizeof(int));
+   }
+   else if (faults.truncateEvery && replies % faults.truncateEvery == 0)
+   {
+      packet->resize(packet->size() / 2);
+      conn->closing= yes;
+   }
+   else if (faults.partialEvery && replies % faults.partialEvery == 0)
+   {
+      // first half now, the rest follows
+
+      size_t half= packet->size() / 2;
+
+      conn->delayed.push_back(std::make_pair(*due, packet->substr(0, half)));
+      packet->erase(0, half);
+      *due+= 100000;
+   }
+}
+
+//***************************************************************************
+// reset
+//***************************************************************************
+
+int MockRConServer::reset(Connection* conn)
+{
+   // RST instead of FIN
+
+   linger lin= { 1, 0 };
+
+   setsockopt(conn->sock, SOL_SOCKET, SO_LINGER, &lin, sizeof(lin));
+
+   return fail;
+}
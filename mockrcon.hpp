@@ -0,0 +1,125 @@
+//***************************************************************************
+// File mockrcon.hpp
+// Date 18.10.26 - #1
+// Copyright (c) 2017-2026 s710 (s710 (at) posteo (dot) de). All rights reserved.
+// --------------------------------------------------------------------------
+// Ark ClusterChat / mock ARK RCON server (benchmarks)
+//***************************************************************************
+
+#ifndef __MOCKRCON_HPP__
+#define __MOCKRCON_HPP__
+
+#include <deque>
+#include <vector>
+#include <string>
+
+#include "thread.hpp"
+
+//***************************************************************************
+// struct MockFaults
+//***************************************************************************
+// faults injected into every connection of a mock, 0 - off.
+// spec: "delay=MS,stall=SEC:MS,reset=N,hang=N,partial=N,truncate=N,bogus=N,auth=N"
+//***************************************************************************
+
+struct MockFaults
+{
+   int delay;            // [ms] every reply
+   int stallEvery;       // [s] no replies for 'stallFor' ms each period (world save)
+   int stallFor;         // [ms]
+   int resetEvery;       // reset the connection on every Nth command
+   int hangEvery;        // stop answering on every Nth command, keep the connection (half open)
+   int partialEvery;     // every Nth reply in two parts, 100 ms apart
+   int truncateEvery;    // every Nth reply cut in half, then closed
+   int bogusEvery;       // every Nth reply with an invalid size field
+   int authEvery;        // refuse every Nth login
+
+   int parse(const char* spec);
+   int any() { return delay || stallEvery || resetEvery || hangEvery || partialEvery || truncateEvery || bogusEvery || authEvery; }
+};
+
+//***************************************************************************
+// class MockRConServer
+//***************************************************************************
+// speaks the same protocol as RConChannel. one listening socket, every
+// accepted connection behaves like a separate game server:
+//
+//  - auth succeeds if the password matches (or no password was set)
+//  - 'GetChat' answers with the configured chat text, or with generated
+//    lines at the configured rate (setChatRate), each carrying its
+//    creation time
+//  - a configured chat text longer than RCON_PACKET_MAX is split into
+//    several packets, an empty RC_RESPONSE packet is mirrored
+//  - any other command answers "Server received, But no response!!",
+//    delayed by setReplyDelay(). 'ServerChat' of a generated line
+//    records its end-to-end latency, if it was sent by "Bench..." (the
+//    default sender, see setSender)
+//  - faults (setFaults) disturb replies and connections on schedule
+//***************************************************************************
+
+class MockRConServer : public Thread
+{
+   public:
+
+      MockRConServer();
+      virtual ~MockRConServer();
+
+      int open(int aPort, const char* aPasswd = 0);
+      int stop() { return Thread::stop(); }
+
+      void setChat(const char* text) { chat.assign(text ? text : ""); }
+      void setChatRate(double linesPerSecond) { chatRate= linesPerSecond; }
+      void setReplyDelay(int ms) { replyDelay= ms; }
+      void setFaults(const MockFaults& aFaults) { faults= aFaults; }
+      void setSender(const char* name) { sender.assign(name); }
+      void takeLatencies(std::vector<unsigned>* latencies);
+
+      int getPort() { return port; }
+      unsigned long long getCommandCount() { return commands; }
+
+   protected:
+
+      struct Connection
+      {
+         int sock;
+         int authenticated;
+         std::string in;
+         std::string out;
+         unsigned long long nextLine;   // [us] generated chat
+         unsigned long long seq;
+         std::deque<std::pair<unsigned long long, std::string> > delayed;   // due [us], packet
+         unsigned long long count;      // commands
+         int hung;
+         int closing;                   // after 'out' is sent
+      };
+
+      int run();
+      int exit();
+
+      int accept();
+      int onReadable(Connection* conn);
+      int onPacket(Connection* conn, int id, int cmd, const char* body);
+      void reply(Connection* conn, int id, int cmd, const char* body, int len, int delay= 0);
+      void generate(Connection* conn, std::string* text);
+      void inject(Connection* conn, std::string* packet, unsigned long long* due);
+      int reset(Connection* conn);
+      void close(size_t index);
+
+      int lsock;
+      int port;
+      std::string passwd;
+      std::string chat;
+      double chatRate;
+      int replyDelay;                 // [ms]
+      MockFaults faults;
+      std::string sender;             // of generated lines
+      unsigned long long logins;
+      unsigned long long replies;
+      Mutex latencyMutex;
+      std::vector<unsigned> latencies;   // [us]
+      std::vector<Connection*> connections;
+      unsigned long long commands;
+};
+
+//***************************************************************************
+#endif // __MOCKRCON_HPP__
@@ -8,6 +8,12 @@
 
 #include "rconthread.hpp"
 #include "channel.hpp"
+#include "filter.hpp"
+#include "rules.hpp"
+#include "utf8.hpp"
+#include "alloc.hpp"
+#include "capture.hpp"
+#include <algorithm>
 #include <stdarg.h>
 #include <string.h>
 #include <stdlib.h>
@@ -27,20 +33,49 @@ RConThread::RConThread(std::list<RConThread*>* aThreads)
    passwd= 0;
    map= 0;
    port= -1;
+   index= 0;
+   warmupPolicy= Globals::cfgWarmup;
+   warmupValue= Globals::cfgWarmupValue;
+   warmup= no;
+   lastPoll= 0;
+   ingestTime= 0;
+   sequence= 0;
+   held= 0;
+   holdTotal= 0;
+   watchRead.beat= watchRead.since= 0;
+   watchWrite.beat= watchWrite.since= 0;
+   holdMax= 0;
    tellBuffer= (char*)calloc(1024*1024, sizeof(char));
    channel= new RConChannel;
+   writeChannel= channel;
+   writer= 0;
 
-   sendBuffer= (char*)calloc(1024*10, sizeof(char));
-   sendBufferSize= 1024*10;
+   format= MessageFormat::get(DEFAULT_FORMAT);
+
+   drainDeadline= 0;
+   ingesting= no;
+   delivered= 0;
+   dropped= 0;
 }
 
 RConThread::~RConThread()
 {
+   MetricsServer::detach(&metrics);
+
    ::free((void*)hostName);
    ::free((void*)passwd);
    ::free((void*)map);
    ::free((void*)tellBuffer);
-   ::free((void*)sendBuffer);
+
+   if (writer)
+   {
+      writer->stop();
+      delete writer;
+   }
+
+   if (writeChannel != channel)
+      delete writeChannel;
+
    delete channel;
 }
 
@@ -50,6 +85,14 @@ RConThread::~RConThread()
 
 int RConThread::start(int blockTimeout, const char* aHostName, int aPort, const char* aPasswd, const char* aMap)
 {
+   // first start, a replay answers from the capture instead of the server
+
+   if (!hostName && Globals::cfgReplayFile)
+   {
+      delete channel;
+      channel= writeChannel= new ReplayChannel(index);
+   }
+
    ::free((void*)hostName);
    ::free((void*)passwd);
    ::free((void*)map);
@@ -58,6 +101,39 @@ int RConThread::start(int blockTimeout, const char* aHostName, int aPort, const
    passwd= strdup(aPasswd);
    map= strdup(aMap);
    port= aPort;
+   ingesting= yes;
+
+   queue.mutex.setName("WorkList", map);
+   waitMutex.setName("Wait", map);
+   tellMutex.setName("Tell", map);
+   controlMutex.setName("Control", map);
+
+   if (Globals::cfgSplitChannels && !writer)
+   {
+      writeChannel= Globals::cfgReplayFile ? new ReplayChannel(index) : new RConChannel;
+      writer= new RConWriter(this);
+   }
+
+   if (Globals::cfgCaptureFile)
+   {
+      channel->setCapture(index);
+      writeChannel->setCapture(index);
+   }
+
+   channel->setTimeout(Globals::cfgRconTimeout);
+   writeChannel->setTimeout(Globals::cfgRconTimeout);
+
+   if (metrics.server.empty())
+   {
+      metrics.server= map;
+      metrics.queueDepth= [this]() { return queue.getCount(); };
+      metrics.heartbeats= [this]() { return getHeartbeat() + (writer ? writer->getHeartbeat() : 0); };
+      metrics.cpuTime= [this]() { return cpuTime() + (writer ? writer->cpuTime() : 0); };
+      MetricsServer::attach(&metrics);
+   }
+
+   channel->setMetrics(&metrics);
+   writeChannel->setMetrics(&metrics);
 
    return Thread::start(blockTimeout);
 }
@@ -68,12 +144,19 @@ int RConThread::start(int blockTimeout, const char* aHostName, int aPort, const
 
 int RConThread::init()
 {
-   int res= channel->connect(hostName, port, passwd);
+   Trace::nameThread(map);
+   setThreadName(map);
 
-   if (!res)
-      tell("Connected to host %s:%d", hostName, port);
-   else
-      error("Error: Failed to connect to host %s:%d (%d)", hostName, port, res);
+   int res= success;
+
+   // a server down at startup is retried like any other outage,
+   // it must not keep the others from starting
+
+   if (open(channel) != success)
+      connectionFailed(channel);
+
+   if (writer)
+      res= writer->start(120);
 
    return res;
 }
@@ -84,43 +167,345 @@ int RConThread::init()
 
 int RConThread::exit()
 {
+   if (writer)
+      writer->stop();
+
    channel->disconnect();
+   writeChannel->disconnect();
+
    return done;
 }
 
+//***************************************************************************
+// open
+//***************************************************************************
+
+int RConThread::open(RConChannel* aChannel)
+{
+   const char* kind= writer ? (aChannel == channel ? " (read)" : " (write)") : "";
+   int res= aChannel->connect(hostName, port, passwd);
+
+   if (!res)
+   {
+      tell("Connected to host %s:%d%s", hostName, port, kind);
+
+      if (aChannel == channel)
+      {
+         warmup= yes;
+         assembler.reset();
+      }
+   }
+   else
+      error("Error: Failed to connect to host %s:%d%s (%d)", hostName, port, kind, res);
+
+   return res;
+}
+
+//***************************************************************************
+// ensure connected
+//***************************************************************************
+
+int RConThread::ensureConnected(RConChannel* aChannel)
+{
+   // yes - channel usable
+   // no  - down, reconnect is not due yet (or failed)
+
+   CircuitBreaker* b= breakerOf(aChannel);
+
+   if (aChannel->isConnected())
+      return yes;
+
+   if (isState(isExit) || !b->mayAttempt())
+      return no;
+
+   if (b->isState(CircuitBreaker::bsHalfOpen))
+      tell("Circuit half open, probing host ...");
+
+   metrics.reconnects.add();
+
+   if (open(aChannel) != success)
+   {
+      connectionFailed(aChannel);
+      return no;
+   }
+
+   if (b->success())
+      tell("Circuit closed, relaying chat again");
+
+   return yes;
+}
+
+//***************************************************************************
+// connection failed
+//***************************************************************************
+
+void RConThread::connectionFailed(RConChannel* aChannel)
+{
+   CircuitBreaker* b= breakerOf(aChannel);
+
+   aChannel->disconnect();
+
+   if (b->failure())
+   {
+      // server is down, stop piling up chat for it
+
+      int count= aChannel == writeChannel ? queue.clear() : 0;
+
+      metrics.dropped.add(count);
+
+      error("Circuit open after %d failure(s), suppressing chat to this server (%d queued message(s) dropped)",
+            b->getFailures(), count);
+   }
+
+   error("Reconnecting in about %d ms (attempt %d)", b->getDelay(), b->getFailures());
+}
+
 //***************************************************************************
 // run
 //***************************************************************************
 
 int RConThread::run()
 {
-   waitMutex.lock();
-
    while (!isState(isExit))
    {
+      beat();
+
       if (threads->size() > 1)
       {
-         control();
+         if (!writer)
+            control();
+
          read();
       }
 
-      if (!isState(isExit))
-         waitCond.timedWaitMs(waitMutex, 1000);
+      // don't hold waitMutex during I/O, other threads take it in wakeUp()
+      // while holding their own (deadlock)
+
+      // the due time is taken under waitMutex, work enqueued after it
+      // signals the wait, work enqueued before is seen by waitTime().
+      // nothing to deliver while disconnected, don't spin on a full queue
+
+      waitMutex.lock();
+
+      int ms= writer || !writeChannel->isConnected() ? 1000 : waitTime();
+      int due= channel->nextDue();
+
+      // replay, poll again when the next response is due
+
+      if (due != na && due < ms)
+         ms= due;
+
+      if (!isState(isExit) && ms)
+         waitCond.timedWaitMs(waitMutex, ms);
+
+      waitMutex.unlock();
    }
 
-   waitMutex.unlock();
+   tell("Shutting down, CPU time %.3f s", cpuTime() / 1000000.0);
 
-   tell("Shutting down");
+   if (flood.getLimited() || flood.getRepeated())
+      tell("Flood control: %llu message(s) limited, %llu repeat(s) collapsed", flood.getLimited(), flood.getRepeated());
+
+   if (held)
+      tell("Reorder window: %llu message(s) held avg %llu ms, max %llu ms, %llu reordered",
+           held, holdTotal / held / 1000, holdMax / 1000, queue.reordered);
+
+   // pending work is drained by us, on the write channel
+
+   if (writer)
+      writer->stop();
+
+   drain();
 
    return 0;
 }
 
+//***************************************************************************
+// Request Stop
+//***************************************************************************
+
+void RConThread::requestStop(int drainTimeoutMs)
+{
+   // pending work will be delivered until deadline, remainder is dropped
+
+   drainDeadline= msNow() + drainTimeoutMs;
+
+   waitMutex.lock();
+   Thread::requestStop(&waitCond);
+   waitMutex.unlock();
+}
+
+//***************************************************************************
+// Abort
+//***************************************************************************
+
+void RConThread::abort()
+{
+   // drain deadline exceeded, wake up a blocking send/recv
+
+   drainDeadline= 0;
+   channel->abort();
+   writeChannel->abort();
+}
+
+//***************************************************************************
+// Finish
+//***************************************************************************
+
+int RConThread::finish()
+{
+   int res= join();
+
+   // other threads may have enqueued after our drain
+
+   dropped+= queue.clear();
+
+   return res;
+}
+
+//***************************************************************************
+// drain
+//***************************************************************************
+
+int RConThread::drain()
+{
+   // deliver pending outbound messages until deadline. peers may still
+   // be in their last read(), so wait for them to finish ingest
+
+   int res= success;
+   Work* work= 0;
+
+   ingesting= no;
+
+   while (threads->size() > 1 && msNow() < drainDeadline && writeChannel->isConnected())
+   {
+      if ((work= queue.dequeue()))
+      {
+         res= write(work);
+         delete work;
+
+         if (res == success || res == wrnNoResponse)
+         {
+            delivered++;
+            continue;
+         }
+
+         // no reconnect while stopping, the rest would fail the same way
+
+         dropped++;
+         break;
+      }
+
+      if (!peersIngesting())
+         break;
+
+      waitMutex.lock();
+
+      if (!queue.getCount())
+         waitCond.timedWaitMs(waitMutex, 50);
+
+      waitMutex.unlock();
+   }
+
+   dropped+= queue.clear();
+
+   if (delivered || dropped)
+      tell("Delivered %d pending message(s), dropped %d", delivered, dropped);
+
+   return done;
+}
+
+//***************************************************************************
+// peersIngesting
+//***************************************************************************
+
+int RConThread::peersIngesting()
+{
+   for (std::list<RConThread*>::iterator it= threads->begin(); it != threads->end(); ++it)
+      if (*it != this && (*it)->ingesting)
+         return yes;
+
+   return no;
+}
+
+//***************************************************************************
+// watch
+//***************************************************************************
+
+static int stuck(Thread* thread, RConThread::Watch* w, unsigned long long now, int limitMs)
+{
+   unsigned long long beat= thread->getHeartbeat();
+
+   if (beat != w->beat || !w->since)
+   {
+      w->beat= beat;
+      w->since= now;
+      return no;
+   }
+
+   if (now - w->since < (unsigned long long)limitMs)
+      return no;
+
+   w->since= now;      // next attempt after another period
+
+   return yes;
+}
+
+int RConThread::watch(unsigned long long now, int limitMs)
+{
+   // called by the watchdog only. a thread without progress is most
+   // likely blocked in send/recv, unblock it, it reconnects on its own.
+   // returns the number of threads reset
+
+   int res= 0;
+
+   if (!isState(isRunning))
+      return 0;
+
+   if (stuck(this, &watchRead, now, limitMs))
+   {
+      error("Watchdog: No progress for %d s, forcing reconnect%s", limitMs / 1000, writer ? " (read)" : "");
+      channel->abort();
+      res++;
+   }
+
+   if (writer && stuck(writer, &watchWrite, now, limitMs))
+   {
+      error("Watchdog: No progress for %d s, forcing reconnect (write)", limitMs / 1000);
+      writeChannel->abort();
+      res++;
+   }
+
+   metrics.stalls.add(res);
+
+   return res;
+}
+
+//***************************************************************************
+// wait time
+//***************************************************************************
+
+int RConThread::waitTime()
+{
+   // [ms] until the next queued message is due, at most 1s
+
+   int res= queue.waitTime(usNow(), Globals::cfgReorderWindow);
+
+   return res == na || res > 1000 ? 1000 : res;
+}
+
 //***************************************************************************
 // Wake Up
 //***************************************************************************
 
 void RConThread::wakeUp()
 {
+   if (writer)
+   {
+      writer->wakeUp();
+      return;
+   }
+
    waitMutex.lock();
    waitCond.broadcast();
    waitMutex.unlock();
@@ -134,15 +519,34 @@ int RConThread::control()
 {
    // process 'work' ...
 
-   Work* work= queue.dequeue();
+   Work* work= 0;
+   unsigned long long now= usNow();
+   int window= Globals::cfgReorderWindow;
+
+   // reconnect even with an empty queue, while the circuit is open peers
+   // don't enqueue and only this probe can close it again
+
+   if (!ensureConnected(writeChannel) || !queue.getCount())
+      return done;
 
-   while (work)
+   // with a reorder window only messages ingested at least 'window' ms
+   // ago are released, later ones of other servers may still sort before
+
+   while (writeChannel->isConnected() && (work= window ? queue.dequeue(now - window * 1000ULL) : queue.dequeue()))
    {
+      if (window)
+      {
+         unsigned long long hold= now - work->message->ingested;
+
+         held++;
+         holdTotal+= hold;
+         holdMax= std::max(holdMax, hold);
+      }
+
       write(work);
+      now= usNow();
 
       delete work;
-
-      work= queue.dequeue();
    }
 
    return done;
@@ -152,18 +556,25 @@ int RConThread::control()
 // command
 //***************************************************************************
 
-int RConThread::command(const char* cmd)
+int RConThread::command(RConChannel* aChannel, const char* cmd)
 {
-   int res= channel->sendCommand(cmd);
+   int res= aChannel->sendCommand(cmd);
 
-   if (res == wrnNoResponse)
+   if (res == wrnNoResponse || res == wrnNotDue)
       ;//tell("No chat messages available");
+   else if (res && isState(isExit))
+   {
+      // shutting down, don't reconnect. the channel is closed anyway,
+      // so pending work isn't tried on a broken socket one by one
+
+      error("Error: Failed to send command (%d)", res);
+      aChannel->disconnect();
+   }
    else if (res)
    {
-      error("Error: Failed to send command (%d), reopening channel ...", res);
+      error("Error: Failed to send command (%d)", res);
 
-      exit();
-      init();
+      connectionFailed(aChannel);
    }
 
    return res;
@@ -175,76 +586,353 @@ int RConThread::command(const char* cmd)
 
 int RConThread::read()
 {
-   int res= command("GetChat");
+   ALLOC_SCOPE(atIngest);
+
+   int res= success;
+   unsigned long long now= msNow();
+
+   if (!ensureConnected(channel))
+      return fail;
+
+   unsigned long long start= usNow();
+
+   res= command(channel, "GetChat");
+   ingestTime= usNow();
+
+   if (!res || res == wrnNoResponse)
+      metrics.getChat.observe(usNow() - start);
+
+   // complete lines only, a cut off tail waits for the next response.
+   // an empty response completes a pending tail, a poll of a replay
+   // before the next record is due does not
+
+   if (!res)
+      assembler.feed(channel->getBuffer(), strlen(channel->getBuffer()), !channel->isTruncated());
+   else if (res == wrnNoResponse && assembler.getPending())
+      assembler.feed("", 0, yes);
+   else if (res == wrnNotDue)
+      assembler.feed("", 0, no);
+   else
+      assembler.reset();
 
-   if (!res && strlen(channel->getBuffer()))
+   if (assembler.getLines().size())
    {
-      char *p1, *p2;
-      p2= channel->getBuffer();
+      TRACE_SPAN("ingest");
 
-      while (true)
+      char* buffer= assembler.getBuffer();
+      const std::vector<LineSpan>& lines= assembler.getLines();
+      std::shared_ptr<const KeywordFilter> filter= KeywordFilter::current();
+      std::shared_ptr<const RuleSet> rules= RuleSet::current();
+
+      metrics.ingested.add(lines.size());
+
+      for (size_t l= warmup ? backlogSkip(lines.size()) : 0; l < lines.size(); l++)
       {
-         p1= strchr(p2, '\n');
+         const LineSpan& line= lines[l];
+         char* text= buffer + line.offset;
+         int len= line.length;
+         ChatLine fields;
 
-         if (p1)
-            *p1= 0;
+         if (line.kind == lkServer)
+            continue;
 
-         if (strncmp(p2, "SERVER: ", 8))
-         {
-            int nQueued= 0;
+         if (line.kind == lkAdmin && !Globals::cfgShowAdmin)
+            continue;
+
+         if (Globals::cfgVerbose)
+            tell("-> [%.*s]", len, text);
+
+         // repair once here instead of per destination
+
+         if (Utf8::sanitize(text, len, &clean) && Globals::cfgVerbose)
+            tell("Sanitized invalid UTF-8 or control characters");
+
+         text= clean.data();
+         len= clean.size();
+
+         if (!len)
+            continue;
+
+         // parsed once, spans are relative to the line and valid for every copy
+
+         fields.parse(text, len, line.kind);
+
+         // filter the body only (not the player names) before fan-out,
+         // masking is done in place and keeps the spans valid
 
-            if (Globals::cfgVerbose)
-               tell("-> [%s]", p2);
+         if (filter && line.kind == lkChat)
+         {
+            char* body= text + fields.body.offset;
 
-            for (std::list<RConThread*>::iterator it= threads->begin(); it != threads->end(); ++it)
+            if (Globals::cfgFilterAction == KeywordFilter::faMask)
+               filter->mask(body, fields.body.length);
+            else if (filter->match(body, fields.body.length))
             {
-               if (!Globals::cfgDebug && *it == this)
-                  continue;
+               if (Globals::cfgFilterAction == KeywordFilter::faDrop)
+               {
+                  if (Globals::cfgVerbose)
+                     tell("Filter: Dropped [%.*s]", len, text);
 
-               if (Globals::cfgDebug && *it != this)
                   continue;
+               }
 
-               if (!Globals::cfgShowAdmin && !strncmp(p2, "AdminCmd", 8))
-                  continue;
+               tell("Filter: Flagged [%.*s]", len, text);
+            }
+         }
+
+         // flood control, a pending repeat summary goes out first
 
-               Work* w= new Work;
-               w->server.assign(map);
-               w->message.assign(p2);
+         if (Globals::cfgFloodRate || Globals::cfgCollapseRepeats)
+         {
+            int result= flood.check(text, &fields, now, &summary);
+
+            if (!summary.empty())
+               relay(summary.c_str(), summary.length(), lkChat, rules.get());
 
-               if (*it == this)
-                  queue.list.push_back(w);
-               else
-                  (*it)->enqueue(w);
+            if (result != FloodControl::frPass)
+            {
+               if (Globals::cfgVerbose)
+                  tell("Flood control: %s [%.*s]", result == FloodControl::frLimited ? "Limited" : "Collapsed", len, text);
 
-               nQueued++;
+               continue;
             }
          }
 
-         p2= p1+1;
-
-         if (!p1 || !*p2)
-            break;
+         relay(text, len, &fields, rules.get());
       }
    }
 
+   // repeats of players who went quiet
+
+   if (flood.flush(now, &summaries))
+   {
+      std::shared_ptr<const RuleSet> rules= RuleSet::current();
+
+      for (size_t i= 0; i < summaries.size(); i++)
+         relay(summaries[i].c_str(), summaries[i].length(), lkChat, rules.get());
+   }
+
+   if (!res || res == wrnNoResponse || res == wrnNotDue)
+   {
+      warmup= no;
+      lastPoll= now;
+   }
+
    return res;
 }
  
+//***************************************************************************
+// relay
+//***************************************************************************
+
+int RConThread::relay(const char* text, int len, int kind, const RuleSet* rules)
+{
+   ChatLine fields;
+
+   fields.parse(text, len, kind);
+
+   return relay(text, len, &fields, rules);
+}
+
+int RConThread::relay(const char* text, int len, const ChatLine* fields, const RuleSet* rules)
+{
+   // queue the message at all destinations, returns their number
+
+   TRACE_SPAN("relay");
+   ALLOC_SCOPE(atRelay);
+
+   std::shared_ptr<Message> message;
+   DestMask targets;
+   unsigned long long enqueued= 0;
+   int nQueued= 0;
+
+   // rules are evaluated once per message, not per destination
+
+   if (rules)
+      targets= rules->route(text, fields, index);
+   else
+      targets.set();
+
+   for (std::list<RConThread*>::iterator it= threads->begin(); it != threads->end(); ++it)
+   {
+      if (!Globals::cfgDebug && *it == this)
+         continue;
+
+      if (Globals::cfgDebug && *it != this)
+         continue;
+
+      if (!targets.test((*it)->getIndex()))
+         continue;
+
+      if (!(*it)->acceptsWork())
+         continue;
+
+      // one copy of the line and one formatting per format,
+      // shared by all destinations
+
+      if (!message)
+      {
+         message= std::make_shared<Message>();
+         message->text.assign(text, len);
+         message->server.assign(map);
+         message->line= *fields;
+         message->ingested= ingestTime;
+         message->source= index;
+         message->id= (unsigned long long)index << 40 | sequence++;
+         enqueued= usNow();
+         formatted.clear();
+      }
+
+      Work* w= new Work;
+      w->message= message;
+      w->commands= formatFor((*it)->getFormat(), message.get());
+      w->enqueued= enqueued;
+
+      (*it)->enqueue(w);
+
+      nQueued++;
+   }
+
+   metrics.relayed.add(nQueued);
+
+   return nQueued;
+}
+
+//***************************************************************************
+// backlog skip
+//***************************************************************************
+
+size_t RConThread::backlogSkip(size_t count)
+{
+   // number of backlog lines not to relay. GetChat lines carry no time,
+   // the backlog is at most as old as our last successful poll
+
+   size_t skip= 0;
+
+   switch (warmupPolicy)
+   {
+      case wpDiscard: skip= count; break;
+      case wpLast:    skip= count > (size_t)warmupValue ? count - warmupValue : 0; break;
+      case wpAge:     skip= lastPoll && msNow() - lastPoll <= warmupValue * 1000ULL ? 0 : count; break;
+      default:        break;
+   }
+
+   if (skip)
+      tell("Skipped %zu of %zu backlog line(s) after connect", skip, count);
+
+   return skip;
+}
+
+//***************************************************************************
+// parse warmup
+//***************************************************************************
+
+int RConThread::parseWarmup(const char* text, int* policy, int* value)
+{
+   // relay | discard | last:N | age:SEC
+
+   *value= 0;
+
+   if (!strcmp(text, "relay"))
+      *policy= wpRelay;
+   else if (!strcmp(text, "discard"))
+      *policy= wpDiscard;
+   else if (!strncmp(text, "last:", 5) && atoi(text + 5) >= 0)
+      *policy= wpLast, *value= atoi(text + 5);
+   else if (!strncmp(text, "age:", 4) && atoi(text + 4) >= 0)
+      *policy= wpAge, *value= atoi(text + 4);
+   else
+   {
+      fprintf(stderr, "Error: Unknown warm-up policy '%s'\n", text);
+      return fail;
+   }
+
+   return success;
+}
+
+//***************************************************************************
+// format for
+//***************************************************************************
+
+std::shared_ptr<const Commands> RConThread::formatFor(const MessageFormat* aFormat, const Message* message)
+{
+   // few distinct formats per cluster, a linear search is fine
+
+   for (size_t i= 0; i < formatted.size(); i++)
+      if (formatted[i].first == aFormat)
+         return formatted[i].second;
+
+   TRACE_SPAN("format");
+   ALLOC_SCOPE(atFormat);
+
+   std::shared_ptr<Commands> commands= std::make_shared<Commands>();
+
+   aFormat->format(message, Globals::cfgMaxMessageLength, commands.get());
+   formatted.push_back(std::make_pair(aFormat, commands));
+
+   return commands;
+}
+
 //***************************************************************************
 // write
 //***************************************************************************
 
 int RConThread::write(Work* work)
 {
+   TRACE_SPAN("write");
+   ALLOC_SCOPE(atWrite);
+
+   // a long backlog is progress as well, for the watchdog
+
+   if (writer)
+      writer->beat();
+   else
+      beat();
+
    int res= success;
+   unsigned long long dequeued= usNow();
+
+   // already formatted in read(), more than one command if split
+
+   for (size_t i= 0; i < work->commands->size() && (!res || res == wrnNoResponse); i++)
+   {
+      const char* cmd= (*work->commands)[i].c_str();
+      unsigned long long start= usNow();
+
+      res= command(writeChannel, cmd);
 
-   resizeBuffer(work->message.length() + strlen(work->server.c_str()) + 30);
-   snprintf(sendBuffer, sendBufferSize-1, "ServerChat [%s] %s", work->server.c_str(), work->message.c_str());
+      if (!res || res == wrnNoResponse)
+         metrics.serverChat.observe(usNow() - start);
 
-   res= command(sendBuffer);
+      if (Globals::cfgVerbose)
+         tell("<- #%llx [%s]", work->message->id, cmd);
+   }
+
+   if (res && res != wrnNoResponse)
+   {
+      metrics.dropped.add();
+      return res;
+   }
+
+   // latency of this path, kept here so only this thread writes it
+
+   const Message* message= work->message.get();
+   unsigned long long now= usNow();
+   unsigned long long total= now - message->ingested;
 
-   if (Globals::cfgVerbose)
-      tell("<- [%s]", sendBuffer);
+   metrics.delivered.add();
+   metrics.endToEnd.observe(total);
+
+   if (message->source < metrics.pathCount)
+   {
+      PathLatency* path= &metrics.paths[message->source];
+
+      path->count.add();
+      path->queued.add(dequeued - work->enqueued);
+      path->sent.add(now - dequeued);
+      path->total.add(total);
+      path->maxTotal.max(total);
+   }
 
    return res;
 }
@@ -258,11 +946,12 @@ void RConThread::tell(const char* format, ...)
    va_list args;
    va_start(args, format);
 
+   tellMutex.lock();
    vsprintf (tellBuffer, format, args);
+   printf("[%s] %s\n", map, tellBuffer);
+   tellMutex.unlock();
 
    va_end (args);
-
-   printf("[%s] %s\n", map, tellBuffer);
 }
 
 //***************************************************************************
@@ -274,24 +963,69 @@ void RConThread::error(const char* format, ...)
    va_list args;
    va_start(args, format);
 
+   tellMutex.lock();
    vsprintf (tellBuffer, format, args);
+   fprintf(stderr, "[%s] %s\n", map, tellBuffer);
+   tellMutex.unlock();
 
    va_end (args);
+}
 
-   fprintf(stderr, "[%s] %s\n", map, tellBuffer);
+//***************************************************************************
+// class RConWriter
+//***************************************************************************
+// init
+//***************************************************************************
+
+int RConWriter::init()
+{
+   std::string name= std::string(owner->map) + " (write)";
+
+   Trace::nameThread(name.c_str());
+   setThreadName(owner->map, "/w");
+   waitMutex.setName("Wait", name.c_str());
+
+   if (owner->open(owner->writeChannel) != success)
+      owner->connectionFailed(owner->writeChannel);
+
+   return success;
 }
 
 //***************************************************************************
-// resizeBuffer
+// run
 //***************************************************************************
 
-void RConThread::resizeBuffer(int newSize)
+int RConWriter::run()
 {
-   if (sendBufferSize >= newSize)
-      return;
+   while (!isState(isExit))
+   {
+      beat();
+      owner->control();
+
+      // due time under waitMutex, see RConThread::run()
+
+      waitMutex.lock();
+
+      int ms= owner->writeChannel->isConnected() ? owner->waitTime() : 1000;
+
+      if (!isState(isExit) && ms)
+         waitCond.timedWaitMs(waitMutex, ms);
+
+      waitMutex.unlock();
+   }
+
+   owner->tell("Writer shutting down, CPU time %.3f s", cpuTime() / 1000000.0);
 
-   sendBuffer= (char*)realloc(sendBuffer, newSize * sizeof(char));
-   sendBufferSize= newSize;
+   return done;
 }
 
+//***************************************************************************
+// Wake Up
+//***************************************************************************
 
+void RConWriter::wakeUp()
+{
+   waitMutex.lock();
+   waitCond.broadcast();
+   waitMutex.unlock();
+}
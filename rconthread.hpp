@@ -12,8 +12,17 @@
 #include <list>                   // std::list
 #include <string>                 // std::string
 #include "thread.hpp"
+#include "breaker.hpp"
+#include "linescan.hpp"
+#include "format.hpp"
+#include "floodctl.hpp"
+#include "metrics.hpp"
+#include "trace.hpp"
+
+class RuleSet;
 
 class RConChannel;
+class RConThread;
 
 //***************************************************************************
 // struct Work, class WorkList
@@ -21,36 +30,59 @@ class RConChannel;
 
 struct Work
 {
-   std::string message;
-   std::string server;
+   std::shared_ptr<const Message> message;
+   std::shared_ptr<const Commands> commands;    // formatted, shared by destinations with equal format
+   unsigned long long enqueued;                 // [us]
 };
 
 class WorkList
 {
    friend class RConThread;
+   friend class RConWriter;
 
    public:
+
+      WorkList() { reordered= 0; }
+      ~WorkList() { clear(); }
       
-      int enqueue(Work* work) 
+      int enqueue(Work* work, int ordered= no) 
       {
          int res= 0;
 
-         mutex.lock();
-         list.push_back(work);
+         {
+            TRACE_SPAN("queue lock");
+            mutex.lock();
+         }
+
+         // ordered by ingest time, usually at the back already
+
+         std::list<Work*>::iterator it= list.end();
+
+         while (ordered && it != list.begin() && (*std::prev(it))->message->ingested > work->message->ingested)
+            --it;
+
+         if (it != list.end())
+            reordered++;
+
+         list.insert(it, work);
          res= (int)list.size();
          mutex.unlock();
 
          return res;
       }
 
-      Work* dequeue()
+      Work* dequeue(unsigned long long releaseBefore= ~0ULL)
       {
          Work* res= 0;
    
-         mutex.lock();
+         {
+            TRACE_SPAN("queue lock");
+            mutex.lock();
+         }
+
          std::list<Work*>::iterator it= list.begin();
    
-         if (it != list.end())
+         if (it != list.end() && (*it)->message->ingested <= releaseBefore)
          {
             res= *it;
             list.pop_front();
@@ -60,21 +92,100 @@ class WorkList
          return res;
       }
 
+      int clear()
+      {
+         int res= 0;
+
+         mutex.lock();
+
+         for (std::list<Work*>::iterator it= list.begin(); it != list.end(); ++it, ++res)
+            delete *it;
+
+         list.clear();
+         mutex.unlock();
+
+         return res;
+      }
+
+      int waitTime(unsigned long long now, int window)
+      {
+         // ms until the first item is due, na if empty. now [us], window [ms]
+
+         int res= na;
+
+         mutex.lock();
+
+         if (list.size())
+         {
+            unsigned long long due= list.front()->message->ingested + window * 1000ULL;
+            res= due > now ? (int)((due - now + 999) / 1000) : 0;
+         }
+
+         mutex.unlock();
+         return res;
+      }
+
       size_t getCount() { return list.size(); }
    
    private:
       
       Mutex mutex;
       std::list<Work*> list;
+      unsigned long long reordered;
+};
+
+//***************************************************************************
+// class RConWriter
+//***************************************************************************
+// optional second connection per server, delivers the queue of its owner
+// independent of the GetChat polling (--split-channels)
+//***************************************************************************
+
+class RConWriter : public Thread
+{
+   public:
+
+      RConWriter(RConThread* aOwner) { owner= aOwner; }
+
+      void wakeUp();
+      int stop() { return Thread::stop(&waitCond); }
+
+   protected:
+
+      int init();
+      int run();
+
+      RConThread* owner;
+      Mutex waitMutex;
+      CondVar waitCond;
 };
 
 //***************************************************************************
 // class RConThread
 //***************************************************************************
+// warm-up: the first GetChat after (re)connect returns everything the
+// server buffered meanwhile, which is relayed according to the policy
+//***************************************************************************
+
+enum WarmupPolicy
+{
+   wpRelay,          // relay all of it
+   wpDiscard,        // drop all of it
+   wpLast,           // relay the last N lines only
+   wpAge             // relay only if we were away at most N seconds
+};
 
 class RConThread : public Thread
 {
+   friend class RConWriter;
+
    public:
+
+      struct Watch                   // last progress seen by the watchdog
+      {
+         unsigned long long beat;
+         unsigned long long since;   // [ms]
+      };
       
       RConThread(std::list<RConThread*>* threads);
       virtual ~RConThread();
@@ -82,11 +193,29 @@ class RConThread : public Thread
       // functions
       
       void wakeUp();
-      void enqueue(Work* work) { queue.enqueue(work); wakeUp(); }
+      void enqueue(Work* work) { queue.enqueue(work, Globals::cfgReorderWindow > 0); wakeUp(); }
+      int acceptsWork() { return !breakerOf(writeChannel)->isOpen(); }
 
       int start(int blockTimeout, const char* aHostName, int aPport, const char* aPasswd, const char* aMap);
       int stop() { return Thread::stop(&waitCond); }
 
+      void requestStop(int drainTimeoutMs);
+      void abort();
+      int finish();
+      int watch(unsigned long long now, int limitMs);
+
+      int getIndex()     { return index; }
+      const MessageFormat* getFormat() { return format; }
+      void setFormat(const MessageFormat* aFormat) { format= aFormat; }
+      void setWarmup(int aPolicy, int aValue) { warmupPolicy= aPolicy; warmupValue= aValue; }
+
+      static int parseWarmup(const char* text, int* policy, int* value);
+      void setIndex(int aIndex) { index= aIndex; metrics.index= aIndex; }
+      void setServerCount(int count) { metrics.setPaths(count); }
+      int getDelivered() { return delivered; }
+      int getDropped()   { return dropped; }
+      unsigned long long getSent() { return metrics.delivered.get(); }
+
    protected:
 
       // frame
@@ -98,30 +227,71 @@ class RConThread : public Thread
       
       int read();
       int write(Work* work);
-      int command(const char* command);
+      int relay(const char* text, int len, int kind, const RuleSet* rules);
+      int relay(const char* text, int len, const ChatLine* fields, const RuleSet* rules);
+      std::shared_ptr<const Commands> formatFor(const MessageFormat* aFormat, const Message* message);
+      int command(RConChannel* aChannel, const char* command);
+      int open(RConChannel* aChannel);
+      int ensureConnected(RConChannel* aChannel);
+      void connectionFailed(RConChannel* aChannel);
+      CircuitBreaker* breakerOf(RConChannel* aChannel) { return aChannel == channel ? &breaker : &writeBreaker; }
 
       // functions
 
       int control();
+      int drain();
+      int peersIngesting();
+      int waitTime();
+      size_t backlogSkip(size_t count);
       void tell(const char* format, ...);
       void error(const char* format, ...);
       
-      void resizeBuffer(int newSize);
-
       // data
 
       Mutex waitMutex;
       CondVar waitCond;
-      WorkList queue;       // write: other thread  read: rconthread
+      Mutex tellMutex;
+      WorkList queue;       // write: other thread  read: rconthread (or its writer)
 
       char* hostName;
       char* passwd;
       char* tellBuffer;
       char* map;
-      char* sendBuffer;
-      int sendBufferSize;
+      LineAssembler assembler;       // lines of GetChat responses
+      std::string clean;             // sanitized line, reused
+      const MessageFormat* format;   // of messages sent to this server
+      FloodControl flood;            // of players on this server
+      std::string summary;
+      std::vector<std::string> summaries;
+      std::vector<std::pair<const MessageFormat*, std::shared_ptr<const Commands> > > formatted;   // of current line
       int port;
-      RConChannel* channel;
+      int index;                   // position in 'threads', used by rules
+      RConChannel* channel;        // GetChat polling
+      RConChannel* writeChannel;   // ServerChat delivery, same as 'channel' unless split
+      RConWriter* writer;
+      CircuitBreaker breaker;        // of 'channel'
+      CircuitBreaker writeBreaker;   // of 'writeChannel', if split
+
+      int warmupPolicy;
+      int warmupValue;
+      int warmup;                    // next GetChat returns the backlog
+      unsigned long long lastPoll;   // last successful GetChat [ms]
+      unsigned long long ingestTime; // of the current GetChat response [us]
+      unsigned long long sequence;   // of ingested messages
+
+      ServerMetrics metrics;         // scraped by MetricsServer
+
+      Watch watchRead;               // watchdog only
+      Watch watchWrite;
+
+      unsigned long long held;       // messages released by the reorder window
+      unsigned long long holdTotal;  // [us] sum of ingest to release
+      unsigned long long holdMax;    // [us]
+
+      unsigned long long drainDeadline;
+      volatile int ingesting;
+      int delivered;
+      int dropped;
       
       std::list<RConThread*>* threads;
 };
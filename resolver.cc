@@ -0,0 +1,214 @@
+//***************************************************************************
+// File resolver.cc
+// Date 18.10.26 - #1
+// Copyright (c) 2017-2026 s710 (s710 (at) posteo (dot) de). All rights reserved.
+// --------------------------------------------------------------------------
+// Ark ClusterChat / DNS cache and background resolver
+//***************************************************************************
+
+#include <stdio.h>
+#include <string.h>
+
+#include <sys/types.h>
+#include <netinet/in.h>
+#include <netdb.h>
+
+#include "resolver.hpp"
+
+//***************************************************************************
+// class Resolver
+//***************************************************************************
+// ctor/dtor
+//***************************************************************************
+
+Resolver::Resolver()
+{
+   mutex.setName("Resolver");
+}
+
+Resolver::~Resolver()
+{
+   // join before our members are gone
+
+   mutex.lock();
+   requestStop(&cond);
+   mutex.unlock();
+
+   join();
+}
+
+//***************************************************************************
+// instance
+//***************************************************************************
+
+Resolver* Resolver::instance()
+{
+   static Resolver resolver;
+   return &resolver;
+}
+
+//***************************************************************************
+// lookup
+//***************************************************************************
+
+int Resolver::lookup(const char* host, int port, AddressList* addresses)
+{
+   Resolver* r= instance();
+   char key[300];
+
+   snprintf(key, sizeof(key), "%s:%d", host ? host : "", port);
+
+   r->mutex.lock();
+
+   if (!r->isState(isRunning))
+      r->start();
+
+   std::map<std::string, Entry>::iterator it= r->cache.find(key);
+
+   if (it != r->cache.end())
+   {
+      // serve even if expired, refresh happens in background
+
+      *addresses= it->second.addresses;
+
+      if (it->second.expires <= msNow() && !it->second.refresh)
+      {
+         it->second.refresh= yes;
+         r->cond.broadcast();
+      }
+
+      r->mutex.unlock();
+      return success;
+   }
+
+   r->mutex.unlock();
+
+   // first lookup of this host, nothing to serve yet
+
+   if (resolve(host, port, addresses) != success)
+      return fail;
+
+   r->mutex.lock();
+
+   Entry& e= r->cache[key];
+   e.host.assign(host);
+   e.port= port;
+   e.addresses= *addresses;
+   e.expires= msNow() + Globals::cfgDnsTtl * 1000ULL;
+   e.nextRefresh= e.expires - Globals::cfgDnsTtl * 1000ULL / 10;
+   e.refresh= no;
+
+   r->mutex.unlock();
+
+   return success;
+}
+
+//***************************************************************************
+// resolve
+//***************************************************************************
+
+int Resolver::resolve(const char* host, int port, AddressList* addresses)
+{
+   char tmp[30];
+   struct addrinfo* serverinfo;
+   struct addrinfo hints;
+   int res;
+
+   sprintf(tmp, "%d", port);
+
+   memset(&hints, 0, sizeof(hints));
+   hints.ai_family   = AF_UNSPEC;
+   hints.ai_socktype = SOCK_STREAM;
+   hints.ai_protocol = IPPROTO_TCP;
+
+   res= getaddrinfo(host, tmp, &hints, &serverinfo);
+
+   if (res)
+   {
+      fprintf(stderr, "Error: Failed to resolve host '%s' (%s)\n", host ? host : "", gai_strerror(res));
+      return fail;
+   }
+
+   // interleave families, IPv6 first (RFC 8305)
+
+   AddressList v6, v4;
+
+   for (struct addrinfo* ai= serverinfo; ai; ai= ai->ai_next)
+   {
+      Address a;
+
+      if (ai->ai_addrlen > sizeof(a.addr))
+         continue;
+
+      memcpy(&a.addr, ai->ai_addr, ai->ai_addrlen);
+      a.len= ai->ai_addrlen;
+      a.family= ai->ai_family;
+
+      (ai->ai_family == AF_INET6 ? v6 : v4).push_back(a);
+   }
+
+   freeaddrinfo(serverinfo);
+
+   addresses->clear();
+
+   for (size_t i= 0; i < v6.size() || i < v4.size(); i++)
+   {
+      if (i < v6.size()) addresses->push_back(v6[i]);
+      if (i < v4.size()) addresses->push_back(v4[i]);
+   }
+
+   return addresses->size() ? success : fail;
+}
+
+//***************************************************************************
+// run
+//***************************************************************************
+
+int Resolver::run()
+{
+   setThreadName("resolver");
+
+   mutex.lock();
+
+   while (!isState(isExit))
+   {
+      unsigned long long now= msNow();
+
+      // refresh entries which are expired or about to expire
+
+      for (std::map<std::string, Entry>::iterator it= cache.begin(); it != cache.end() && !isState(isExit); ++it)
+      {
+         if (!it->second.refresh && it->second.nextRefresh > now)
+            continue;
+
+         std::string host= it->second.host;
+         int port= it->second.port;
+         AddressList addresses;
+
+         mutex.unlock();
+         int res= resolve(host.c_str(), port, &addresses);
+         mutex.lock();
+
+         // entries are never erased, iterator stays valid.
+         // on failure keep serving the old addresses, retry later
+
+         if (res == success)
+         {
+            it->second.addresses= addresses;
+            it->second.expires= msNow() + Globals::cfgDnsTtl * 1000ULL;
+            it->second.nextRefresh= it->second.expires - Globals::cfgDnsTtl * 1000ULL / 10;
+         }
+         else
+            it->second.nextRefresh= msNow() + 10000;
+
+         it->second.refresh= no;
+      }
+
+      if (!isState(isExit))
+         cond.timedWaitMs(mutex, 1000);
+   }
+
+   mutex.unlock();
+
+   return done;
+}
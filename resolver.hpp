@@ -0,0 +1,75 @@
+//***************************************************************************
+// File resolver.hpp
+// Date 18.10.26 - #1
+// Copyright (c) 2017-2026 s710 (s710 (at) posteo (dot) de). All rights reserved.
+// --------------------------------------------------------------------------
+// Ark ClusterChat / DNS cache and background resolver
+//***************************************************************************
+
+#ifndef __RESOLVER_HPP__
+#define __RESOLVER_HPP__
+
+#include <sys/socket.h>
+#include <map>
+#include <string>
+#include <vector>
+
+#include "thread.hpp"
+
+//***************************************************************************
+// struct Address
+//***************************************************************************
+
+struct Address
+{
+   sockaddr_storage addr;
+   socklen_t len;
+   int family;
+};
+
+typedef std::vector<Address> AddressList;
+
+//***************************************************************************
+// class Resolver
+//***************************************************************************
+// process wide address cache, shared by all connections. only the very
+// first lookup of a host blocks. entries are refreshed in the background
+// before they expire (cfgDnsTtl, getaddrinfo() does not report the record
+// TTL), expired entries are still served while the refresh is pending,
+// so a reconnect never waits for DNS.
+//***************************************************************************
+
+class Resolver : public Thread
+{
+   public:
+
+      virtual ~Resolver();
+
+      static int lookup(const char* host, int port, AddressList* addresses);
+
+   protected:
+
+      struct Entry
+      {
+         std::string host;
+         int port;
+         AddressList addresses;
+         unsigned long long expires;       // [ms]
+         unsigned long long nextRefresh;   // [ms]
+         int refresh;
+      };
+
+      Resolver();
+
+      static Resolver* instance();
+      static int resolve(const char* host, int port, AddressList* addresses);
+
+      int run();
+
+      Mutex mutex;
+      CondVar cond;
+      std::map<std::string, Entry> cache;
+};
+
+//***************************************************************************
+#endif // __RESOLVER_HPP__
@@ -0,0 +1,555 @@
+//***************************************************************************
+// File rules.cc
+// Date 18.10.26 - #1
+// Copyright (c) 2017-2026 s710 (s710 (at) posteo (dot) de). All rights reserved.
+// --------------------------------------------------------------------------
+// Ark ClusterChat / relay rules
+//***************************************************************************
+
+#include <stdio.h>
+#include <string.h>
+#include <strings.h>
+#include <ctype.h>
+#include <errno.h>
+#include <time.h>
+#include <algorithm>
+
+#include "rules.hpp"
+
+#define MAX_DEPTH 16
+
+//***************************************************************************
+// class RuleSet
+//***************************************************************************
+
+Mutex RuleSet::activeMutex("RuleSet");
+std::shared_ptr<const RuleSet> RuleSet::active;
+std::vector<std::string> RuleSet::servers;
+
+//***************************************************************************
+// tokenizer
+//***************************************************************************
+
+static int nextToken(const char** p, std::string* token)
+{
+   // returns first character of the token, 0 at end of line,
+   // na on an unterminated quote
+
+   const char* s= *p;
+
+   while (*s == ' ' || *s == '\t')
+      s++;
+
+   token->clear();
+
+   if (!*s || *s == '\n' || *s == '\r' || *s == '#')
+   {
+      *p= s;
+      return 0;
+   }
+
+   if (*s == '(' || *s == ')' || *s == ',')
+   {
+      token->assign(s, 1);
+      *p= s + 1;
+      return *token->c_str();
+   }
+
+   if (*s == '"')
+   {
+      const char* e= strchr(s + 1, '"');
+
+      if (!e)
+         return na;
+
+      token->assign(s + 1, e - s - 1);
+      *p= e + 1;
+      return '"';
+   }
+
+   const char* b= s;
+
+   while (*s && !isspace((unsigned char)*s) && !strchr("(),\"#", *s))
+      s++;
+
+   token->assign(b, s - b);
+   *p= s;
+
+   return (unsigned char)*b;
+}
+
+static int peekToken(const char* p, std::string* token)
+{
+   return nextToken(&p, token);
+}
+
+static int unexpected(int lineNo, int c, const std::string& token)
+{
+   if (c == na)
+      fprintf(stderr, "Error: Rules line %d: unterminated quote\n", lineNo);
+   else
+      fprintf(stderr, "Error: Rules line %d: unexpected '%s'\n", lineNo, token.c_str());
+
+   return fail;
+}
+
+static unsigned long long nsNow()
+{
+   struct timespec ts;
+
+   clock_gettime(CLOCK_MONOTONIC, &ts);
+
+   return ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+//***************************************************************************
+// load
+//***************************************************************************
+
+int RuleSet::load(const char* path)
+{
+   char line[1024];
+   int lineNo= 0;
+   FILE* f= fopen(path, "r");
+
+   if (!f)
+   {
+      fprintf(stderr, "Error: Failed to open rules file '%s' (%s)\n", path, strerror(errno));
+      return fail;
+   }
+
+   for (size_t i= 0; i < servers.size() && i < MAX_SERVERS; i++)
+      all.set(i);
+
+   while (fgets(line, sizeof(line), f))
+   {
+      if (parse(line, ++lineNo) != success)
+      {
+         fclose(f);
+         return fail;
+      }
+   }
+
+   fclose(f);
+
+   stats.reset(new Stats[rules.size()]);
+
+   return success;
+}
+
+//***************************************************************************
+// parse
+//***************************************************************************
+
+int RuleSet::parse(const char* text, int lineNo)
+{
+   const char* p= text;
+   std::string token;
+   Rule rule;
+   int c;
+
+   if (!(c= nextToken(&p, &token)))
+      return success;                            // empty or comment
+
+   if (c == na)
+      return unexpected(lineNo, c, token);
+
+   if (token != "allow" && token != "deny")
+   {
+      fprintf(stderr, "Error: Rules line %d: expected 'allow' or 'deny', got '%s'\n", lineNo, token.c_str());
+      return fail;
+   }
+
+   rule.allow= token == "allow";
+   rule.from= all;
+   rule.to= all;
+   rule.first= code.size();
+   rule.count= 0;
+   rule.depth= 0;
+   rule.source.assign(text, strcspn(text, "\r\n"));
+
+   // every token up to the end of the line must be understood, a rule
+   // is never compiled from a prefix
+
+   while ((c= nextToken(&p, &token)))
+   {
+      if (token == "from")
+      {
+         if (parseList(&p, &rule.from, lineNo) != success)
+            return fail;
+      }
+      else if (token == "to")
+      {
+         if (parseList(&p, &rule.to, lineNo) != success)
+            return fail;
+      }
+      else if (token == "if")
+      {
+         if (parseCondition(&p, lineNo) != success)
+            return fail;
+
+         if ((c= peekToken(p, &token)))
+            return unexpected(lineNo, c, token);
+      }
+      else
+         return unexpected(lineNo, c, token);
+   }
+
+   // stack depth of the postfix code
+
+   rule.count= code.size() - rule.first;
+
+   for (int i= rule.first, depth= 0; i < rule.first + rule.count; i++)
+   {
+      depth+= code[i].code == opTest || code[i].code == opAdmin ? 1 : code[i].code == opNot ? 0 : -1;
+      rule.depth= std::max(rule.depth, depth);
+   }
+
+   if (rule.depth > MAX_DEPTH)
+   {
+      fprintf(stderr, "Error: Rules line %d: condition too complex\n", lineNo);
+      return fail;
+   }
+
+   rules.push_back(rule);
+
+   return success;
+}
+
+//***************************************************************************
+// parse list
+//***************************************************************************
+
+int RuleSet::parseList(const char** p, DestMask* mask, int lineNo)
+{
+   std::string token;
+
+   mask->reset();
+
+   do
+   {
+      size_t i;
+
+      nextToken(p, &token);
+
+      for (i= 0; i < servers.size() && i < MAX_SERVERS; i++)
+         if (!strcasecmp(servers[i].c_str(), token.c_str()))
+            break;
+
+      if (i == servers.size() || i == MAX_SERVERS)
+      {
+         fprintf(stderr, "Error: Rules line %d: unknown server '%s'\n", lineNo, token.c_str());
+         return fail;
+      }
+
+      mask->set(i);
+
+   } while (peekToken(*p, &token) == ',' && nextToken(p, &token));
+
+   return success;
+}
+
+//***************************************************************************
+// parse condition / term / factor
+//***************************************************************************
+
+int RuleSet::parseCondition(const char** p, int lineNo)
+{
+   std::string token;
+
+   if (parseTerm(p, lineNo) != success)
+      return fail;
+
+   while (peekToken(*p, &token) && token == "or")
+   {
+      nextToken(p, &token);
+
+      if (parseTerm(p, lineNo) != success)
+         return fail;
+
+      code.push_back(Op{opOr, 0, 0, 0});
+   }
+
+   return success;
+}
+
+int RuleSet::parseTerm(const char** p, int lineNo)
+{
+   std::string token;
+
+   if (parseFactor(p, lineNo) != success)
+      return fail;
+
+   while (peekToken(*p, &token) && token == "and")
+   {
+      nextToken(p, &token);
+
+      if (parseFactor(p, lineNo) != success)
+         return fail;
+
+      code.push_back(Op{opAnd, 0, 0, 0});
+   }
+
+   return success;
+}
+
+int RuleSet::parseFactor(const char** p, int lineNo)
+{
+   static const char* fields[]= { "player", "character", "channel", "body", "line", 0 };
+   static const char* tests[]=  { "is", "prefix", "contains", 0 };
+   std::string token;
+   Op op= { opTest, 0, 0, 0 };
+   int f, t, c;
+
+   nextToken(p, &token);
+
+   if (token == "not")
+   {
+      if (parseFactor(p, lineNo) != success)
+         return fail;
+
+      code.push_back(Op{opNot, 0, 0, 0});
+      return success;
+   }
+
+   if (token == "(")
+   {
+      if (parseCondition(p, lineNo) != success)
+         return fail;
+
+      if (nextToken(p, &token) != ')')
+      {
+         fprintf(stderr, "Error: Rules line %d: missing ')'\n", lineNo);
+         return fail;
+      }
+
+      return success;
+   }
+
+   if (token == "admin")
+   {
+      code.push_back(Op{opAdmin, 0, 0, 0});
+      return success;
+   }
+
+   for (f= 0; fields[f] && token != fields[f]; f++) ;
+
+   if (!fields[f])
+   {
+      fprintf(stderr, "Error: Rules line %d: unknown field '%s'\n", lineNo, token.c_str());
+      return fail;
+   }
+
+   nextToken(p, &token);
+
+   for (t= 0; tests[t] && token != tests[t]; t++) ;
+
+   if (!tests[t])
+   {
+      fprintf(stderr, "Error: Rules line %d: unknown test '%s'\n", lineNo, token.c_str());
+      return fail;
+   }
+
+   if ((c= nextToken(p, &token)) == na)
+      return unexpected(lineNo, c, token);
+
+   if (!c)
+   {
+      fprintf(stderr, "Error: Rules line %d: missing text\n", lineNo);
+      return fail;
+   }
+
+   op.field= f;
+   op.test= t;
+   op.text= texts.size();
+   texts.push_back(token);
+   code.push_back(op);
+
+   return success;
+}
+
+//***************************************************************************
+// test
+//***************************************************************************
+
+static int test(int what, std::string_view value, const std::string& text)
+{
+   switch (what)
+   {
+      case RuleSet::rtIs:
+         return value.size() == text.size() && !strncasecmp(value.data(), text.c_str(), text.size());
+
+      case RuleSet::rtPrefix:
+         return value.size() >= text.size() && !strncasecmp(value.data(), text.c_str(), text.size());
+
+      case RuleSet::rtContains:
+      {
+         for (size_t i= 0; i + text.size() <= value.size(); i++)
+            if (!strncasecmp(value.data() + i, text.c_str(), text.size()))
+               return yes;
+
+         return no;
+      }
+   }
+
+   return no;
+}
+
+//***************************************************************************
+// evaluate
+//***************************************************************************
+
+int RuleSet::evaluate(const Rule& rule, const char* line, const ChatLine* fields) const
+{
+   int stack[MAX_DEPTH];
+   int sp= 0;
+
+   for (int i= rule.first; i < rule.first + rule.count; i++)
+   {
+      const Op& op= code[i];
+
+      switch (op.code)
+      {
+         case opTest:
+         {
+            std::string_view value;
+
+            switch (op.field)
+            {
+               case rfPlayer:    value= fields->steamName.view(line);     break;
+               case rfCharacter: value= fields->characterName.view(line); break;
+               case rfChannel:   value= fields->channel.view(line);       break;
+               case rfBody:      value= fields->body.view(line);          break;
+               default:          value= std::string_view(line, fields->body.offset + fields->body.length); break;
+            }
+
+            stack[sp++]= test(op.test, value, texts[op.text]);
+            break;
+         }
+
+         case opAdmin: stack[sp++]= fields->kind == lkAdmin;              break;
+         case opNot:   stack[sp-1]= !stack[sp-1];                         break;
+         case opAnd:   sp--; stack[sp-1]= stack[sp-1] && stack[sp];       break;
+         case opOr:    sp--; stack[sp-1]= stack[sp-1] || stack[sp];       break;
+      }
+   }
+
+   return sp ? stack[0] : yes;
+}
+
+//***************************************************************************
+// route
+//***************************************************************************
+
+DestMask RuleSet::route(const char* line, const ChatLine* fields, int source) const
+{
+   // returns the destinations the message may be relayed to
+
+   DestMask decided, allowed;
+
+   for (size_t r= 0; r < rules.size() && decided != all; r++)
+   {
+      const Rule& rule= rules[r];
+      DestMask open= rule.to & ~decided;
+
+      if (!open.any() || source < 0 || source >= MAX_SERVERS || !rule.from.test(source))
+         continue;
+
+      int match= yes;
+
+      // unconditional rules are not worth two clock reads
+
+      if (rule.count)
+      {
+         unsigned long long start= nsNow();
+
+         match= evaluate(rule, line, fields);
+         stats[r].ns.fetch_add(nsNow() - start, std::memory_order_relaxed);
+      }
+
+      stats[r].evaluations.fetch_add(1, std::memory_order_relaxed);
+
+      if (!match)
+         continue;
+
+      stats[r].matches.fetch_add(1, std::memory_order_relaxed);
+
+      if (rule.allow)
+         allowed|= open;
+
+      decided|= open;
+   }
+
+   return allowed | (all & ~decided);
+}
+
+//***************************************************************************
+// report
+//***************************************************************************
+
+void RuleSet::report() const
+{
+   for (size_t r= 0; r < rules.size(); r++)
+   {
+      unsigned long long evaluations= stats[r].evaluations.load(std::memory_order_relaxed);
+
+      printf("Rules: #%zu evaluated %llu, matched %llu, %.0f ns avg  [%s]\n",
+             r + 1, evaluations, stats[r].matches.load(std::memory_order_relaxed),
+             evaluations ? (double)stats[r].ns.load(std::memory_order_relaxed) / evaluations : 0.0,
+             rules[r].source.c_str());
+   }
+}
+
+//***************************************************************************
+// current
+//***************************************************************************
+
+std::shared_ptr<const RuleSet> RuleSet::current()
+{
+   std::shared_ptr<const RuleSet> res;
+
+   activeMutex.lock();
+   res= active;
+   activeMutex.unlock();
+
+   return res;
+}
+
+//***************************************************************************
+// set servers
+//***************************************************************************
+
+void RuleSet::setServers(const std::vector<std::string>& titles)
+{
+   servers= titles;
+}
+
+//***************************************************************************
+// reload
+//***************************************************************************
+
+int RuleSet::reload()
+{
+   // on failure the previous rules stay active
+
+   if (!Globals::cfgRulesFile)
+      return done;
+
+   std::shared_ptr<RuleSet> rules= std::make_shared<RuleSet>();
+   std::shared_ptr<const RuleSet> old;
+
+   if (rules->load(Globals::cfgRulesFile) != success)
+      return fail;
+
+   printf("Rules: Loaded %d rule(s) from '%s'\n", rules->getCount(), Globals::cfgRulesFile);
+
+   activeMutex.lock();
+   old= active;
+   active= rules;
+   activeMutex.unlock();
+
+   if (old)
+      old->report();
+
+   return success;
+}
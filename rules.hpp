@@ -0,0 +1,131 @@
+//***************************************************************************
+// File rules.hpp
+// Date 18.10.26 - #1
+// Copyright (c) 2017-2026 s710 (s710 (at) posteo (dot) de). All rights reserved.
+// --------------------------------------------------------------------------
+// Ark ClusterChat / relay rules
+//***************************************************************************
+
+#ifndef __RULES_HPP__
+#define __RULES_HPP__
+
+#include <atomic>
+#include <bitset>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include "thread.hpp"
+#include "chatline.hpp"
+
+#define MAX_SERVERS 512
+
+typedef std::bitset<MAX_SERVERS> DestMask;
+
+//***************************************************************************
+// class RuleSet
+//***************************************************************************
+// one rule per line, first matching rule decides per destination,
+// messages not matched by any rule are relayed:
+//
+//   allow|deny [from SERVER,...] [to SERVER,...] [if CONDITION]
+//
+//   CONDITION := TERM [or TERM ...]
+//   TERM      := FACTOR [and FACTOR ...]
+//   FACTOR    := not FACTOR | ( CONDITION ) | admin | FIELD TEST "TEXT"
+//   FIELD     := player | character | channel | body | line
+//   TEST      := is | prefix | contains          (case insensitive)
+//
+// conditions are compiled into postfix bytecode, a message is routed
+// once into a destination mask, not once per destination.
+//***************************************************************************
+
+class RuleSet
+{
+   public:
+
+      enum Field
+      {
+         rfPlayer,
+         rfCharacter,
+         rfChannel,
+         rfBody,
+         rfLine
+      };
+
+      enum Code
+      {
+         opTest,           // push(field TEST text)
+         opAdmin,          // push(admin command)
+         opNot,
+         opAnd,
+         opOr
+      };
+
+      enum Test
+      {
+         rtIs,
+         rtPrefix,
+         rtContains
+      };
+
+      int load(const char* path);
+      DestMask route(const char* line, const ChatLine* fields, int source) const;
+      void report() const;
+
+      int getCount() const { return rules.size(); }
+
+      // active rule set
+
+      static std::shared_ptr<const RuleSet> current();
+      static void setServers(const std::vector<std::string>& titles);
+      static int reload();
+
+   protected:
+
+      struct Op
+      {
+         unsigned char code;
+         unsigned char field;
+         unsigned char test;
+         unsigned short text;     // index into 'texts'
+      };
+
+      struct Rule
+      {
+         int allow;
+         DestMask from;
+         DestMask to;
+         int first;               // first op
+         int count;               // number of ops, 0 - unconditional
+         int depth;               // stack needed
+         std::string source;
+      };
+
+      struct Stats
+      {
+         std::atomic<unsigned long long> evaluations {0};
+         std::atomic<unsigned long long> matches {0};
+         std::atomic<unsigned long long> ns {0};
+      };
+
+      int parse(const char* text, int lineNo);
+      int parseList(const char** p, DestMask* mask, int lineNo);
+      int parseCondition(const char** p, int lineNo);
+      int parseTerm(const char** p, int lineNo);
+      int parseFactor(const char** p, int lineNo);
+      int evaluate(const Rule& rule, const char* line, const ChatLine* fields) const;
+
+      std::vector<Rule> rules;
+      std::vector<Op> code;
+      std::vector<std::string> texts;
+      std::unique_ptr<Stats[]> stats;
+      DestMask all;
+
+      static Mutex activeMutex;
+      static std::shared_ptr<const RuleSet> active;
+      static std::vector<std::string> servers;
+};
+
+//***************************************************************************
+#endif // __RULES_HPP__
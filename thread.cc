@@ -10,6 +10,7 @@
 #include <signal.h>
 #include <stdlib.h>
 #include <sys/time.h>
+#include <time.h>
 #include <string.h>
 #include <stdio.h>
 
@@ -30,27 +31,115 @@ static void absTime(timespec* abstime, int milli)
    abstime->tv_sec  = now.tv_sec + (milli / 1000) + (usec / 1000000);
 }
 
+//***************************************************************************
+// Monotonic Time
+//***************************************************************************
+
+unsigned long long msNow()
+{
+   timespec ts;
+   clock_gettime(CLOCK_MONOTONIC, &ts);
+
+   return (unsigned long long)ts.tv_sec * 1000 + ts.tv_nsec / 1000000;
+}
+
+unsigned long long usNow()
+{
+   timespec ts;
+   clock_gettime(CLOCK_MONOTONIC, &ts);
+
+   return (unsigned long long)ts.tv_sec * 1000000 + ts.tv_nsec / 1000;
+}
+
 //***************************************************************************
 // Mutex
 //***************************************************************************
 
-Mutex::Mutex()
+#ifdef LOCKSTATS
+
+static pthread_mutex_t registryMutex = PTHREAD_MUTEX_INITIALIZER;
+static Mutex* registry = 0;
+
+static unsigned long long nsNow()
+{
+   timespec ts;
+   clock_gettime(CLOCK_MONOTONIC, &ts);
+
+   return (unsigned long long)ts.tv_sec * 1000000000 + ts.tv_nsec;
+}
+
+#endif
+
+Mutex::Mutex(const char* aName)
 {
    locked = 0;
    pthread_mutexattr_t attr;
    pthread_mutexattr_init(&attr);
    pthread_mutexattr_settype(&attr, PTHREAD_MUTEX_ERRORCHECK);
    pthread_mutex_init(&mutex, &attr);
+
+#ifdef LOCKSTATS
+   strcpy(name, "unnamed");
+   acquisitions = contended = waitTotal = waitMax = 0;
+   holdStart = holdTotal = holdMax = condWaits = 0;
+   memset(waits, 0, sizeof(waits));
+
+   pthread_mutex_lock(&registryMutex);
+   prev = 0;
+   next = registry;
+   if (registry) registry->prev = this;
+   registry = this;
+   pthread_mutex_unlock(&registryMutex);
+#endif
+
+   if (aName)
+      setName(aName);
 }
 
 Mutex::~Mutex()
 {
+#ifdef LOCKSTATS
+   pthread_mutex_lock(&registryMutex);
+   if (prev) prev->next = next; else registry = next;
+   if (next) next->prev = prev;
+   pthread_mutex_unlock(&registryMutex);
+#endif
+
    pthread_mutex_destroy(&mutex);
 }
 
 void Mutex::lock()
 {
+#ifdef LOCKSTATS
+   int res = pthread_mutex_trylock(&mutex);
+
+   // EBUSY is also returned if we hold it already, lock() then fails with EDEADLK
+
+   if (res == EBUSY)
+   {
+      unsigned long long start = nsNow();
+
+      if (!(res = pthread_mutex_lock(&mutex)))
+      {
+         unsigned long long wait = nsNow() - start;
+         int bucket = 0;
+
+         while (bucket < LOCK_BUCKETS - 1 && wait >= (1000ULL << bucket))
+            bucket++;
+
+         contended++;
+         waitTotal += wait;
+         waits[bucket]++;
+         if (wait > waitMax) waitMax = wait;
+      }
+   }
+
+   if (!res)
+      acquired();
+#else
    pthread_mutex_lock(&mutex);
+#endif
+
    locked++;
 }
 
@@ -61,6 +150,10 @@ int Mutex::tryLock()
    else
       locked++;
 
+#ifdef LOCKSTATS
+   acquired();
+#endif
+
    return success;
 }
 
@@ -71,10 +164,86 @@ void Mutex::unlock()
    if (locked <= 0)
    {
       locked = 0;
+#ifdef LOCKSTATS
+      released();
+#endif
       pthread_mutex_unlock(&mutex);
    }
 }
 
+//***************************************************************************
+// Set Name
+//***************************************************************************
+
+void Mutex::setName(const char* aName, const char* owner)
+{
+#ifdef LOCKSTATS
+   if (owner)
+      snprintf(name, sizeof(name), "%s[%s]", aName, owner);
+   else
+      snprintf(name, sizeof(name), "%s", aName);
+#endif
+}
+
+#ifdef LOCKSTATS
+
+//***************************************************************************
+// Acquired / Released
+//***************************************************************************
+
+void Mutex::acquired()
+{
+   acquisitions++;
+   holdStart = nsNow();
+}
+
+void Mutex::released()
+{
+   unsigned long long hold = nsNow() - holdStart;
+
+   holdTotal += hold;
+   if (hold > holdMax) holdMax = hold;
+}
+
+#endif
+
+//***************************************************************************
+// Dump Stats
+//***************************************************************************
+
+void Mutex::dumpStats()
+{
+#ifdef LOCKSTATS
+   // values are read without the mutexes, a dump may be slightly inconsistent
+
+   printf("Locks: %-32s %10s %10s %8s %10s %14s %14s %14s %8s  %s\n", "name", "acquired", "contended", "[%]",
+          "wait [ms]", "wait max [us]", "hold avg [us]", "hold max [us]", "cond", "wait <1,2,4..16384us,more");
+
+   pthread_mutex_lock(&registryMutex);
+
+   for (Mutex* m = registry; m; m = m->next)
+   {
+      char hist[200] = "";
+      size_t len = 0;
+
+      if (!m->acquisitions)
+         continue;
+
+      for (int i = 0; i < LOCK_BUCKETS; i++)
+         len += snprintf(hist + len, sizeof(hist) - len, "%s%llu", i ? "," : "", m->waits[i]);
+
+      printf("Locks: %-32s %10llu %10llu %8.2f %10.3f %14.1f %14.2f %14.1f %8llu  %s\n", m->name,
+             m->acquisitions, m->contended, 100.0 * m->contended / m->acquisitions,
+             m->waitTotal / 1000000.0, m->waitMax / 1000.0,
+             m->holdTotal / 1000.0 / m->acquisitions, m->holdMax / 1000.0, m->condWaits, hist);
+   }
+
+   pthread_mutex_unlock(&registryMutex);
+#else
+   printf("Locks: Lock statistics not available, build with 'make LOCKSTATS=1'\n");
+#endif
+}
+
 //***************************************************************************
 // CondVar
 //***************************************************************************
@@ -97,7 +266,14 @@ void CondVar::wait(Mutex& mutex)
 
    int locked = mutex.locked;
    mutex.locked = 0;
+#ifdef LOCKSTATS
+   mutex.condWaits++;
+   mutex.released();
+#endif
    pthread_cond_wait(&cond, &mutex.mutex);
+#ifdef LOCKSTATS
+   mutex.holdStart = nsNow();
+#endif
    mutex.locked = locked;
 }
 
@@ -121,10 +297,17 @@ int CondVar::timedWaitMs(Mutex& mutex, int timeoutMs)
 
       int locked = mutex.locked;
       mutex.locked = 0;
+#ifdef LOCKSTATS
+      mutex.condWaits++;
+      mutex.released();
+#endif
 
       if (pthread_cond_timedwait(&cond, &mutex.mutex, &abstime) == ETIMEDOUT)
          r = no;
 
+#ifdef LOCKSTATS
+      mutex.holdStart = nsNow();
+#endif
       mutex.locked = locked;
    }
 
@@ -149,7 +332,9 @@ Thread::Thread()
    childTid   = 0;
    state      = isUnknown;
    joined     = no;
+   heartbeat  = 0;
 
+   controlMutex.setName("Control");
    pthread_attr_init(&attr);
 }
 
@@ -162,6 +347,45 @@ Thread::~Thread()
    pthread_attr_destroy(&attr);
 }
 
+//***************************************************************************
+// CPU Time
+//***************************************************************************
+
+unsigned long long Thread::cpuTime()
+{
+   // [us] consumed by the thread so far, 0 if it is not running
+
+   clockid_t clock;
+   timespec ts;
+
+   if (!childTid || isState(isStopped))
+      return 0;
+
+   if (pthread_getcpuclockid(childTid, &clock) || clock_gettime(clock, &ts))
+      return 0;
+
+   return (unsigned long long)ts.tv_sec * 1000000 + ts.tv_nsec / 1000;
+}
+
+//***************************************************************************
+// Set Thread Name
+//***************************************************************************
+
+void Thread::setThreadName(const char* name, const char* suffix)
+{
+   // of the calling thread, as shown by top -H, ps -L and perf. the
+   // kernel keeps 15 characters, the suffix is kept if the name is longer
+
+   char buf[16];
+   int len = suffix ? strlen(suffix) : 0;
+
+   if (len > 15)
+      len = 15;
+
+   snprintf(buf, sizeof(buf), "%.*s%s", 15 - len, name, suffix ? suffix : "");
+   pthread_setname_np(pthread_self(), buf);
+}
+
 //***************************************************************************
 // Start
 //***************************************************************************
@@ -224,7 +448,13 @@ void* Thread::startThread(Thread* thread)
       thread->exitStatus += thread->run();
 
    thread->exitStatus += thread->exit();
+
+   // probably wake up parent, waiting in ::waitForStopped()
+
+   thread->controlMutex.lock();
    thread->setState(isStopped);
+   thread->controlCondVar.broadcast();
+   thread->controlMutex.unlock();
 
    return 0;
 }
@@ -249,12 +479,67 @@ int Thread::waitForStarted(int timeout)
 
 int Thread::stop(CondVar* condVar)
 {
-   int res= success;
+   requestStop(condVar);
 
-   setState(isExit);
+   return join();
+}
+
+//***************************************************************************
+// Request Stop
+//***************************************************************************
+
+void Thread::requestStop(CondVar* condVar)
+{
+   // signal only, does not join. allows stopping many threads in parallel
+
+   controlMutex.lock();
+
+   if (!isState(isStopped))
+      setState(isExit);
+
+   controlMutex.unlock();
 
    if (condVar)
       condVar->broadcast();
+}
+
+//***************************************************************************
+// wait for stopped
+//***************************************************************************
+
+int Thread::waitForStopped(int timeoutMs)
+{
+   unsigned long long deadline= msNow() + timeoutMs;
+
+   // yes - thread has left its mainloop
+   // no  - timeout
+
+   controlMutex.lock();
+
+   while (childTid && !isState(isStopped))
+   {
+      unsigned long long now= msNow();
+
+      if (now >= deadline)
+         break;
+
+      controlCondVar.timedWaitMs(controlMutex, (int)(deadline - now));
+   }
+
+   int res= !childTid || isState(isStopped) ? yes : no;
+
+   controlMutex.unlock();
+
+   return res;
+}
+
+//***************************************************************************
+// Join
+//***************************************************************************
+
+int Thread::join()
+{
+   int res= success;
 
    if (childTid)
       res= pthread_join(childTid, 0);
@@ -10,11 +10,26 @@
 #define THREAD_HPP
 
 #include <pthread.h>
+#include <atomic>
 #include "def.h"
 
+//***************************************************************************
+// Time
+//***************************************************************************
+
+unsigned long long msNow();       // monotonic milliseconds
+unsigned long long usNow();       // monotonic microseconds
+
 //***************************************************************************
 // Class Mutex
 //***************************************************************************
+// built with LOCKSTATS=1 every mutex counts acquisitions, contended
+// acquisitions, the time spent waiting for it (power of 2 buckets [us])
+// and the time it was held. statistics are kept in the mutex itself and
+// only written while it is held. dumpStats() prints all live mutexes.
+//***************************************************************************
+
+#define LOCK_BUCKETS 16       // wait < 1us, < 2us, ... < 16ms, longer
 
 class Mutex
 {
@@ -22,7 +37,7 @@ class Mutex
 
    public:
 
-      Mutex();
+      Mutex(const char* aName= 0);
       ~Mutex();
 
       void lock();
@@ -32,10 +47,32 @@ class Mutex
       int getLockCount() { return locked; }
       int tryLock();
 
+      void setName(const char* aName, const char* owner= 0);
+      static void dumpStats();
+
    private:
 
       pthread_mutex_t mutex;
       int locked;
+
+#ifdef LOCKSTATS
+      void acquired();
+      void released();
+
+      char name[64];
+      unsigned long long acquisitions;
+      unsigned long long contended;
+      unsigned long long waitTotal;      // [ns]
+      unsigned long long waitMax;        // [ns]
+      unsigned long long waits[LOCK_BUCKETS];
+      unsigned long long holdStart;      // [ns]
+      unsigned long long holdTotal;      // [ns]
+      unsigned long long holdMax;        // [ns]
+      unsigned long long condWaits;      // released by CondVar waits
+
+      Mutex* prev;                       // registry of live mutexes
+      Mutex* next;
+#endif
 };
 
 //***************************************************************************
@@ -82,11 +119,23 @@ class Thread
       virtual int start(int blockTimeout = na);
       virtual int stop(CondVar* condVar = 0);
 
+      void requestStop(CondVar* condVar = 0);
+      int waitForStopped(int timeoutMs);
+      int join();
+
       // tests
 
       int isState(State aState) { return state == aState; }
       int sameThread() { return childTid == pthread_self(); }
 
+      // progress and usage, read by other threads
+
+      void beat() { heartbeat.fetch_add(1, std::memory_order_relaxed); }
+      unsigned long long getHeartbeat() { return heartbeat.load(std::memory_order_relaxed); }
+      unsigned long long cpuTime();
+
+      static void setThreadName(const char* name, const char* suffix = 0);
+
    protected:
 
       void setState(State aState) { state = aState; }
@@ -111,6 +160,7 @@ class Thread
 
       pthread_t childTid;
       pthread_attr_t attr;
+      std::atomic<unsigned long long> heartbeat;   // loops of run()
 };
 
 #endif // THREAD_HPP
@@ -0,0 +1,140 @@
+//***************************************************************************
+// File trace.cc
+// Date 18.10.26 - #1
+// Copyright (c) 2017-2026 s710 (s710 (at) posteo (dot) de). All rights reserved.
+// --------------------------------------------------------------------------
+// Ark ClusterChat / hot path span tracing (Chrome trace format)
+//***************************************************************************
+
+#include <stdio.h>
+#include <string.h>
+#include <errno.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/syscall.h>
+
+#include "trace.hpp"
+
+int Trace::enabled= no;
+Mutex Trace::mutex("Trace");
+std::list<std::unique_ptr<Trace::Buffer> > Trace::buffers;
+thread_local Trace::Buffer* Trace::local= 0;
+
+//***************************************************************************
+// ns now
+//***************************************************************************
+
+unsigned long long Trace::nsNow()
+{
+   timespec ts;
+   clock_gettime(CLOCK_MONOTONIC, &ts);
+
+   return (unsigned long long)ts.tv_sec * 1000000000 + ts.tv_nsec;
+}
+
+//***************************************************************************
+// buffer
+//***************************************************************************
+
+Trace::Buffer* Trace::buffer()
+{
+   // created on first use by the calling thread, kept until exit so
+   // spans of finished threads are still dumped
+
+   if (!local)
+   {
+      Buffer* b= new Buffer;
+
+      b->tid= (int)syscall(SYS_gettid);
+      b->head= 0;
+
+      mutex.lock();
+      buffers.push_back(std::unique_ptr<Buffer>(b));
+      mutex.unlock();
+
+      local= b;
+   }
+
+   return local;
+}
+
+//***************************************************************************
+// name thread
+//***************************************************************************
+
+void Trace::nameThread(const char* name)
+{
+   if (!enabled)
+      return;
+
+   Buffer* b= buffer();
+
+   mutex.lock();
+   b->name.assign(name);
+   mutex.unlock();
+}
+
+//***************************************************************************
+// record
+//***************************************************************************
+
+void Trace::record(const char* name, unsigned long long begin, unsigned long long end)
+{
+   Buffer* b= buffer();
+   unsigned long long h= b->head.load(std::memory_order_relaxed);
+   Event* e= &b->events[h & (TRACE_EVENTS - 1)];
+
+   e->name= name;
+   e->begin= begin;
+   e->end= end;
+
+   b->head.store(h + 1, std::memory_order_release);
+}
+
+//***************************************************************************
+// dump
+//***************************************************************************
+
+int Trace::dump(const char* path)
+{
+   FILE* f= fopen(path, "w");
+   int count= 0;
+
+   if (!f)
+   {
+      fprintf(stderr, "Trace: Error: Failed to open '%s' (%s)\n", path, strerror(errno));
+      return fail;
+   }
+
+   fprintf(f, "{\"traceEvents\":[\n");
+
+   mutex.lock();
+
+   for (std::list<std::unique_ptr<Buffer> >::iterator it= buffers.begin(); it != buffers.end(); ++it)
+   {
+      Buffer* b= it->get();
+      unsigned long long head= b->head.load(std::memory_order_acquire);
+      unsigned long long first= head > TRACE_EVENTS ? head - TRACE_EVENTS : 0;
+
+      fprintf(f, "%s{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":1,\"tid\":%d,\"args\":{\"name\":\"%s\"}}",
+              count++ ? ",\n" : "", b->tid, b->name.empty() ? "main" : b->name.c_str());
+
+      for (unsigned long long i= first; i < head; i++)
+      {
+         const Event* e= &b->events[i & (TRACE_EVENTS - 1)];
+
+         fprintf(f, ",\n{\"name\":\"%s\",\"ph\":\"X\",\"pid\":1,\"tid\":%d,\"ts\":%.3f,\"dur\":%.3f}",
+                 e->name, b->tid, e->begin / 1000.0, (e->end - e->begin) / 1000.0);
+         count++;
+      }
+   }
+
+   mutex.unlock();
+
+   fprintf(f, "\n]}\n");
+   fclose(f);
+
+   printf("Trace: Wrote %d event(s) to '%s'\n", count, path);
+
+   return success;
+}
@@ -0,0 +1,99 @@
+//***************************************************************************
+// File trace.hpp
+// Date 18.10.26 - #1
+// Copyright (c) 2017-2026 s710 (s710 (at) posteo (dot) de). All rights reserved.
+// --------------------------------------------------------------------------
+// Ark ClusterChat / hot path span tracing (Chrome trace format)
+//***************************************************************************
+
+#ifndef __TRACE_HPP__
+#define __TRACE_HPP__
+
+#include <atomic>
+#include <list>
+#include <memory>
+#include <string>
+
+#include "thread.hpp"
+
+#define TRACE_EVENTS 65536    // per thread, power of 2, oldest are overwritten
+
+#define TRACE_SPAN(name) TraceSpan __traceSpan(name)
+
+//***************************************************************************
+// class Trace
+//***************************************************************************
+// spans are recorded into a ring per thread, only the owning thread
+// writes it. with tracing off a span costs one predictable branch.
+// dump() writes the rings as Chrome trace JSON (chrome://tracing,
+// ui.perfetto.dev), events overwritten during the dump may be garbled.
+//***************************************************************************
+
+class Trace
+{
+   public:
+
+      struct Event
+      {
+         const char* name;            // static string
+         unsigned long long begin;    // [ns] monotonic
+         unsigned long long end;
+      };
+
+      static int enabled;
+
+      static void nameThread(const char* name);
+      static void record(const char* name, unsigned long long begin, unsigned long long end);
+      static int dump(const char* path);
+      static unsigned long long nsNow();
+
+   protected:
+
+      struct Buffer
+      {
+         int tid;
+         std::string name;
+         std::atomic<unsigned long long> head;   // events written
+         Event events[TRACE_EVENTS];
+      };
+
+      static Buffer* buffer();
+
+      static Mutex mutex;
+      static std::list<std::unique_ptr<Buffer> > buffers;
+      static thread_local Buffer* local;
+};
+
+//***************************************************************************
+// class TraceSpan
+//***************************************************************************
+
+class TraceSpan
+{
+   public:
+
+      TraceSpan(const char* aName)
+      {
+         if (__builtin_expect(Trace::enabled, 0))
+         {
+            name= aName;
+            begin= Trace::nsNow();
+         }
+         else
+            name= 0;
+      }
+
+      ~TraceSpan()
+      {
+         if (__builtin_expect(name != 0, 0))
+            Trace::record(name, begin, Trace::nsNow());
+      }
+
+   private:
+
+      const char* name;
+      unsigned long long begin;
+};
+
+//***************************************************************************
+#endif // __TRACE_HPP__
@@ -0,0 +1,147 @@
+//***************************************************************************
+// File utf8.cc
+// Date 18.10.26 - #1
+// Copyright (c) 2017-2026 s710 (s710 (at) posteo (dot) de). All rights reserved.
+// --------------------------------------------------------------------------
+// Ark ClusterChat / UTF-8 validation, sanitizing and splitting
+//***************************************************************************
+
+#include <string.h>
+
+#if defined(__SSE2__)
+#  include <emmintrin.h>
+#endif
+
+#include "utf8.hpp"
+
+//***************************************************************************
+// sanitize
+//***************************************************************************
+
+int Utf8::sanitize(const char* text, int len, std::string* out)
+{
+   // returns number of bytes replaced or removed
+
+   const unsigned char* p= (const unsigned char*)text;
+   int i= 0, changed= 0;
+   char* d;
+
+   // worst case every byte becomes U+FFFD (3 bytes)
+
+   if ((int)out->size() < len * 3)
+      out->resize(len * 3);
+
+   d= &(*out)[0];
+
+   while (i < len)
+   {
+#if defined(__SSE2__)
+      // printable ASCII fast path: signed compare catches < 0x20 and >= 0x80
+
+      while (i + 16 <= len)
+      {
+         __m128i v= _mm_loadu_si128((const __m128i*)(p + i));
+         __m128i bad= _mm_or_si128(_mm_cmplt_epi8(v, _mm_set1_epi8(0x20)),
+                                   _mm_cmpeq_epi8(v, _mm_set1_epi8(0x7f)));
+
+         if (_mm_movemask_epi8(bad))
+            break;
+
+         _mm_storeu_si128((__m128i*)d, v);
+         d+= 16;
+         i+= 16;
+      }
+
+      if (i >= len)
+         break;
+#endif
+
+      unsigned char c= p[i];
+      int need= 0;
+      unsigned char lo= 0x80, hi= 0xbf;
+
+      if (c < 0x80)
+      {
+         if (c >= 0x20 && c != 0x7f)
+            *d++= c;
+         else if (c == '\t')
+            *d++= ' ', changed++;
+         else
+            changed++;
+
+         i++;
+         continue;
+      }
+
+      // lead byte, range of the first continuation byte (RFC 3629)
+
+      if (c >= 0xc2 && c <= 0xdf)      need= 1;
+      else if (c == 0xe0)              need= 2, lo= 0xa0;
+      else if (c == 0xed)              need= 2, hi= 0x9f;
+      else if (c >= 0xe1 && c <= 0xef) need= 2;
+      else if (c == 0xf0)              need= 3, lo= 0x90;
+      else if (c == 0xf4)              need= 3, hi= 0x8f;
+      else if (c >= 0xf1 && c <= 0xf3) need= 3;
+
+      int valid= need && i + need < len && p[i+1] >= lo && p[i+1] <= hi;
+
+      for (int k= 2; valid && k <= need; k++)
+         valid= p[i+k] >= 0x80 && p[i+k] <= 0xbf;
+
+      if (!valid)
+      {
+         memcpy(d, "\xef\xbf\xbd", 3);
+         d+= 3;
+         i++;
+         changed++;
+         continue;
+      }
+
+      // C1 controls U+0080..U+009F
+
+      if (c == 0xc2 && p[i+1] < 0xa0)
+         changed+= 2;
+      else
+      {
+         memcpy(d, p + i, need + 1);
+         d+= need + 1;
+      }
+
+      i+= need + 1;
+   }
+
+   out->resize(d - out->data());
+
+   return changed;
+}
+
+//***************************************************************************
+// split
+//***************************************************************************
+
+int Utf8::split(const char* text, int len, int maxLen)
+{
+   // length of the first chunk of at most maxLen bytes, ends on a code
+   // point boundary, preferably at a space in the second half
+
+   int cut= maxLen;
+
+   if (len <= maxLen)
+      return len;
+
+   while (cut > 0 && ((unsigned char)text[cut] & 0xc0) == 0x80)
+      cut--;
+
+   for (int i= cut; i > maxLen / 2; i--)
+      if (text[i] == ' ')
+         return i;
+
+   if (cut > 0)
+      return cut;
+
+   // maxLen is shorter than the first code point, never cut it in half
+
+   for (cut= 1; cut < len && ((unsigned char)text[cut] & 0xc0) == 0x80; cut++) ;
+
+   return cut;
+}
@@ -0,0 +1,32 @@
+//***************************************************************************
+// File utf8.hpp
+// Date 18.10.26 - #1
+// Copyright (c) 2017-2026 s710 (s710 (at) posteo (dot) de). All rights reserved.
+// --------------------------------------------------------------------------
+// Ark ClusterChat / UTF-8 validation, sanitizing and splitting
+//***************************************************************************
+
+#ifndef __UTF8_HPP__
+#define __UTF8_HPP__
+
+#include <string>
+
+//***************************************************************************
+// class Utf8
+//***************************************************************************
+// sanitize() copies a chat line, invalid sequences (overlong, surrogates,
+// truncated, > U+10FFFF) are replaced by U+FFFD, control characters (C0,
+// DEL, C1) are removed, tabs become spaces. blocks of printable ASCII,
+// the common case, are copied 16 bytes at a time (SSE2).
+//***************************************************************************
+
+class Utf8
+{
+   public:
+
+      static int sanitize(const char* text, int len, std::string* out);
+      static int split(const char* text, int len, int maxLen);
+};
+
+//***************************************************************************
+#endif // __UTF8_HPP__
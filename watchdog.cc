@@ -0,0 +1,71 @@
+//***************************************************************************
+// File watchdog.cc
+// Date 18.10.26 - #1
+// Copyright (c) 2017-2026 s710 (s710 (at) posteo (dot) de). All rights reserved.
+// --------------------------------------------------------------------------
+// Ark ClusterChat / watchdog of the server threads
+//***************************************************************************
+
+#include <stdio.h>
+
+#include "watchdog.hpp"
+#include "rconthread.hpp"
+
+//***************************************************************************
+// class Watchdog
+//***************************************************************************
+// ctor/dtor
+//***************************************************************************
+
+Watchdog::Watchdog(std::list<RConThread*>* aThreads)
+{
+   threads= aThreads;
+   limit= 0;
+   waitMutex.setName("Watchdog");
+}
+
+Watchdog::~Watchdog()
+{
+   stop();
+}
+
+//***************************************************************************
+// open
+//***************************************************************************
+
+int Watchdog::open(int aLimit)
+{
+   limit= aLimit;
+   printf("Watchdog: Forcing a reconnect after %d s without progress\n", limit);
+
+   return start();
+}
+
+//***************************************************************************
+// run
+//***************************************************************************
+
+int Watchdog::run()
+{
+   setThreadName("watchdog");
+
+   while (!isState(isExit))
+   {
+      waitMutex.lock();
+
+      if (!isState(isExit))
+         waitCond.timedWaitMs(waitMutex, 1000);
+
+      waitMutex.unlock();
+
+      if (isState(isExit))
+         break;
+
+      unsigned long long now= msNow();
+
+      for (std::list<RConThread*>::iterator it= threads->begin(); it != threads->end(); ++it)
+         (*it)->watch(now, limit * 1000);
+   }
+
+   return done;
+}
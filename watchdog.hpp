@@ -0,0 +1,47 @@
+//***************************************************************************
+// File watchdog.hpp
+// Date 18.10.26 - #1
+// Copyright (c) 2017-2026 s710 (s710 (at) posteo (dot) de). All rights reserved.
+// --------------------------------------------------------------------------
+// Ark ClusterChat / watchdog of the server threads
+//***************************************************************************
+
+#ifndef __WATCHDOG_HPP__
+#define __WATCHDOG_HPP__
+
+#include <list>
+
+#include "thread.hpp"
+
+class RConThread;
+
+//***************************************************************************
+// class Watchdog
+//***************************************************************************
+// checks the heartbeat of every server thread (and its writer) once a
+// second, a thread without progress for 'limit' seconds is forced to
+// reconnect (--watchdog)
+//***************************************************************************
+
+class Watchdog : public Thread
+{
+   public:
+
+      Watchdog(std::list<RConThread*>* aThreads);
+      virtual ~Watchdog();
+
+      int open(int aLimit);
+      int stop() { return Thread::stop(&waitCond); }
+
+   protected:
+
+      int run();
+
+      std::list<RConThread*>* threads;
+      int limit;                 // [s]
+      Mutex waitMutex;
+      CondVar waitCond;
+};
+
+//***************************************************************************
+#endif // __WATCHDOG_HPP__